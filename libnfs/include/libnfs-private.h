@@ -127,6 +127,12 @@ struct rpc_context {
 	uint32_t inpos;
 	char rm_buf[4];
 	char *inbuf;
+	/* READ reply whose data is being received straight into the
+	 * caller's buffer, see rpc_place_reply() */
+	int inplace_checked;
+	struct rpc_pdu *inplace;
+	uint32_t inplace_pos;
+	uint32_t inplace_len;
 
 	/* special fields for UDP, which can sometimes be BROADCASTed */
 	int is_udp;
@@ -157,6 +163,14 @@ struct rpc_context {
         struct rpc_endpoint *endpoints;
 };
 
+/*
+ * Finds the opaque<> body to place in pdu->indata, given the first len bytes
+ * of a successful reply's result. Returns -1 if there is none, 0 with the
+ * body's offset in res and length in *pos and *count, or the number of
+ * bytes it needs to look at to tell.
+ */
+typedef int (*rpc_place_fn)(const char *res, uint32_t len, uint32_t *pos, uint32_t *count);
+
 struct rpc_pdu {
 	struct rpc_pdu *next;
 
@@ -165,6 +179,13 @@ struct rpc_pdu {
 
 	uint32_t written;
 	struct rpc_data outdata;
+	/* sent after outdata straight from the caller's buffer,
+	 * see rpc_pdu_add_payload() */
+	struct rpc_data payload;
+	/* where the data of the reply may be received to, and how to
+	 * find it in the reply, see rpc_place_reply() */
+	struct rpc_data indata;
+	rpc_place_fn place_fn;
 
 	rpc_cb cb;
 	void *private_data;
@@ -189,6 +210,9 @@ struct rpc_pdu *rpc_allocate_pdu(struct rpc_context *rpc, int program, int versi
 struct rpc_pdu *rpc_allocate_pdu2(struct rpc_context *rpc, int program, int version, int procedure, rpc_cb cb, void *private_data, zdrproc_t zdr_decode_fn, int zdr_bufsize, size_t alloc_hint);
 void rpc_free_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu);
 int rpc_queue_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu);
+int rpc_pdu_add_payload(struct rpc_pdu *pdu, char *buf, uint32_t len);
+uint32_t rpc_pdu_out_size(struct rpc_pdu *pdu);
+uint32_t rpc_place_reply(struct rpc_context *rpc, const char *buf, uint32_t len, uint32_t size);
 uint32_t rpc_get_pdu_size(char *buf);
 int rpc_process_pdu(struct rpc_context *rpc, char *buf, int size);
 void rpc_error_all_pdus(struct rpc_context *rpc, const char *error);
@@ -329,6 +353,7 @@ struct nfs_cb_data {
        char *buffer;
        int not_my_buffer;
        const char *usrbuf;
+       char *dstbuf;
        int update_pos;
 };
 
@@ -446,8 +471,8 @@ int nfs3_open_async(struct nfs_context *nfs, const char *path, int flags,
 int nfs3_opendir_async(struct nfs_context *nfs, const char *path, nfs_cb cb,
                        void *private_data);
 int nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
-                              uint64_t offset, size_t count, nfs_cb cb,
-                              void *private_data, int update_pos);
+                              uint64_t offset, size_t count, char *buf,
+                              nfs_cb cb, void *private_data, int update_pos);
 int nfs3_pwrite_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
                                uint64_t offset, size_t count, const char *buf,
                                nfs_cb cb, void *private_data, int update_pos);
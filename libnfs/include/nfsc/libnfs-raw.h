@@ -988,6 +988,16 @@ struct READ3args;
 EXTERN int rpc_nfs3_read_async(struct rpc_context *rpc, rpc_cb cb,
                                struct READ3args *args,
                                void *private_data);
+/*
+ * As rpc_nfs3_read_async(), but the data of the reply ends up in buf, which
+ * must have room for args->count bytes and stay valid until the callback
+ * has been invoked. Over TCP the data is received straight into buf instead
+ * of being copied out of the reply, and data.data_val of the READ3res
+ * passed to the callback then points at buf.
+ */
+EXTERN int rpc_nfs3_read_into_async(struct rpc_context *rpc, rpc_cb cb,
+                                    struct READ3args *args, char *buf,
+                                    void *private_data);
 EXTERN int rpc_nfs_read_async(struct rpc_context *rpc, rpc_cb cb,
                               struct nfs_fh3 *fh,
                               uint64_t offset, uint64_t count,
@@ -88,6 +88,10 @@ struct ZDR {
 	int size;
 	int pos;
 	struct zdr_mem *mem;
+	/* decoding: the opaque<> body at placed_pos was received
+	 * into placed rather than buf */
+	char *placed;
+	int placed_pos;
 };
 typedef struct ZDR ZDR;
 
@@ -616,6 +616,18 @@ EXTERN int nfs_close(struct nfs_context *nfs, struct nfsfh *nfsfh);
 EXTERN int nfs_pread_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
                            uint64_t offset, uint64_t count, nfs_cb cb,
                            void *private_data);
+/*
+ * Async pread() into a buffer of the caller's
+ *
+ * As nfs_pread_async(), but the data is put in buf, which must have room
+ * for count bytes and stay valid until the callback has been invoked. On
+ * success data is buf. With NFSv3 over TCP the data is received from the
+ * socket straight into buf, unless the read has to be widened for the
+ * pagecache or readahead.
+ */
+EXTERN int nfs_pread_into_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
+                                uint64_t offset, uint64_t count, void *buf,
+                                nfs_cb cb, void *private_data);
 /*
  * Sync pread()
  * Function returns
@@ -648,6 +660,12 @@ EXTERN int nfs_pread(struct nfs_context *nfs, struct nfsfh *nfsfh,
  */
 EXTERN int nfs_read_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
                           uint64_t count, nfs_cb cb, void *private_data);
+/*
+ * Async read() into a buffer of the caller's, see nfs_pread_into_async()
+ */
+EXTERN int nfs_read_into_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
+                               uint64_t count, void *buf, nfs_cb cb,
+                               void *private_data);
 /*
  * Sync read()
  * Function returns
@@ -666,6 +684,9 @@ EXTERN int nfs_read(struct nfs_context *nfs, struct nfsfh *nfsfh,
 /*
  * Async pwrite()
  *
+ * buf is sent as it is, without being copied, and must not be freed or
+ * modified until the callback has been invoked.
+ *
  * Function returns
  *  0 : The command was queued successfully. The callback will be invoked once
  *      the command completes.
@@ -697,6 +718,8 @@ EXTERN int nfs_pwrite(struct nfs_context *nfs, struct nfsfh *nfsfh,
 /*
  * Async write()
  *
+ * As for nfs_pwrite_async(), buf must stay untouched until the callback.
+ *
  * Function returns
  *  0 : The command was queued successfully. The callback will be invoked once
  *      the command completes.
@@ -77,6 +77,8 @@ void libnfs_zdrmem_create(ZDR *zdrs, const caddr_t addr, uint32_t size, enum zdr
 	zdrs->size = size;
 	zdrs->pos  = 0;
 	zdrs->mem = NULL;
+	zdrs->placed = NULL;
+	zdrs->placed_pos = 0;
 }
 
 void *zdr_malloc(ZDR *zdrs, uint32_t size)
@@ -163,6 +165,7 @@ bool_t libnfs_zdr_bytes(ZDR *zdrs, char **bufp, uint32_t *size, uint32_t maxsize
 {
         uint32_t zero = 0;
         int pad;
+	char *src;
 
 	if (!libnfs_zdr_u_int(zdrs, size)) {
 		return FALSE;
@@ -185,10 +188,16 @@ bool_t libnfs_zdr_bytes(ZDR *zdrs, char **bufp, uint32_t *size, uint32_t maxsize
                 }
 		return TRUE;
 	case ZDR_DECODE:
+		src = &zdrs->buf[zdrs->pos];
+		if (zdrs->placed != NULL && zdrs->pos == zdrs->placed_pos) {
+			src = zdrs->placed;
+		}
 		if (*bufp != NULL) {
-			memcpy(*bufp, &zdrs->buf[zdrs->pos], *size);
+			if (*bufp != src) {
+				memcpy(*bufp, src, *size);
+			}
 		} else {
-			*bufp = &zdrs->buf[zdrs->pos];
+			*bufp = src;
 		}
 		zdrs->pos += *size;
 		zdrs->pos = (zdrs->pos + 3) & ~3;
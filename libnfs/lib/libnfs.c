@@ -1065,7 +1065,7 @@ nfs_pread_async(struct nfs_context *nfs, struct nfsfh *nfsfh, uint64_t offset,
 	switch (nfs->version) {
         case NFS_V3:
                 return nfs3_pread_async_internal(nfs, nfsfh, offset,
-                                                 (size_t)count,
+                                                 (size_t)count, NULL,
                                                  cb, private_data, 0);
         case NFS_V4:
                 return nfs4_pread_async_internal(nfs, nfsfh, offset,
@@ -1078,6 +1078,92 @@ nfs_pread_async(struct nfs_context *nfs, struct nfsfh *nfsfh, uint64_t offset,
         }
 }
 
+struct nfs_read_into_data {
+	nfs_cb cb;
+	void *private_data;
+	void *buf;
+};
+
+/* Copies the result of a read without a buffer of its own into buf */
+static void
+nfs_read_into_cb(int err, struct nfs_context *nfs, void *data,
+                 void *private_data)
+{
+	struct nfs_read_into_data *rd = private_data;
+
+	if (err > 0) {
+		memcpy(rd->buf, data, err);
+	}
+	if (err >= 0) {
+		data = rd->buf;
+	}
+	rd->cb(err, nfs, data, rd->private_data);
+	free(rd);
+}
+
+static int
+nfs4_pread_into_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
+                      uint64_t offset, uint64_t count, void *buf,
+                      nfs_cb cb, void *private_data, int update_pos)
+{
+	struct nfs_read_into_data *rd;
+	int ret;
+
+	rd = malloc(sizeof(struct nfs_read_into_data));
+	if (rd == NULL) {
+		nfs_set_error(nfs, "Out of memory.");
+		return -1;
+	}
+	rd->cb = cb;
+	rd->private_data = private_data;
+	rd->buf = buf;
+	ret = nfs4_pread_async_internal(nfs, nfsfh, offset, (size_t)count,
+                                        nfs_read_into_cb, rd, update_pos);
+	if (ret != 0) {
+		free(rd);
+	}
+	return ret;
+}
+
+int
+nfs_pread_into_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
+                     uint64_t offset, uint64_t count, void *buf,
+                     nfs_cb cb, void *private_data)
+{
+	switch (nfs->version) {
+        case NFS_V3:
+                return nfs3_pread_async_internal(nfs, nfsfh, offset,
+                                                 (size_t)count, buf,
+                                                 cb, private_data, 0);
+        case NFS_V4:
+                return nfs4_pread_into_async(nfs, nfsfh, offset, count, buf,
+                                             cb, private_data, 0);
+        default:
+                nfs_set_error(nfs, "%s does not support NFSv%d",
+                              __FUNCTION__, nfs->version);
+                return -1;
+        }
+}
+
+int
+nfs_read_into_async(struct nfs_context *nfs, struct nfsfh *nfsfh,
+                    uint64_t count, void *buf, nfs_cb cb, void *private_data)
+{
+	switch (nfs->version) {
+        case NFS_V3:
+                return nfs3_pread_async_internal(nfs, nfsfh, nfsfh->offset,
+                                                 (size_t)count, buf,
+                                                 cb, private_data, 1);
+        case NFS_V4:
+                return nfs4_pread_into_async(nfs, nfsfh, nfsfh->offset, count,
+                                             buf, cb, private_data, 1);
+        default:
+                nfs_set_error(nfs, "%s does not support NFSv%d",
+                              __FUNCTION__, nfs->version);
+                return -1;
+        }
+}
+
 int
 nfs_read_async(struct nfs_context *nfs, struct nfsfh *nfsfh, uint64_t count,
                nfs_cb cb, void *private_data)
@@ -1085,7 +1171,7 @@ nfs_read_async(struct nfs_context *nfs, struct nfsfh *nfsfh, uint64_t count,
 	switch (nfs->version) {
         case NFS_V3:
                 return nfs3_pread_async_internal(nfs, nfsfh, nfsfh->offset,
-                                                 (size_t)count,
+                                                 (size_t)count, NULL,
                                                  cb, private_data, 1);
         case NFS_V4:
                 return nfs4_pread_async_internal(nfs, nfsfh, nfsfh->offset,
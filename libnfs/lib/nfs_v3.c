@@ -4462,6 +4462,31 @@ nfs3_fill_READ3args(READ3args *args, struct nfsfh *fh, uint64_t offset,
 	args->count = (count3)count;
 }
 
+static char *
+nfs3_pread_dest(struct nfs_cb_data *data, struct nfs_mcb_data *mdata)
+{
+	/* reading straight into the caller's buffer */
+	if (data->dstbuf != NULL && data->buffer == data->dstbuf) {
+		return &data->buffer[mdata->offset - data->offset];
+	}
+	return NULL;
+}
+
+/* Where the result of a read is, in the caller's buffer if it gave one */
+static char *
+nfs3_pread_result(struct nfs_cb_data *data, size_t count)
+{
+	char *res = data->buffer + (data->org_offset - data->offset);
+
+	if (data->dstbuf == NULL) {
+		return res;
+	}
+	if (count > 0 && res != data->dstbuf) {
+		memcpy(data->dstbuf, res, count);
+	}
+	return data->dstbuf;
+}
+
 static void
 nfs3_pread_mcb(struct rpc_context *rpc, int status, void *command_data,
                void *private_data)
@@ -4513,7 +4538,10 @@ nfs3_pread_mcb(struct rpc_context *rpc, int status, void *command_data,
 					data->not_my_buffer = 1;
 				} else if (count <= mdata->count) {
 					/* copy data into reassembly buffer */
-					memcpy(&data->buffer[mdata->offset - data->offset], res->READ3res_u.resok.data.data_val, count);
+					char *dst = &data->buffer[mdata->offset - data->offset];
+					if (res->READ3res_u.resok.data.data_val != dst) {
+						memcpy(dst, res->READ3res_u.resok.data.data_val, count);
+					}
 				} else {
 					nfs_set_error(nfs, "NFS: Read overflow. Server has sent more data than requested!");
 					data->error = 1;
@@ -4536,9 +4564,11 @@ nfs3_pread_mcb(struct rpc_context *rpc, int status, void *command_data,
 					nfs3_fill_READ3args(&args, data->nfsfh,
                                                             mdata->offset,
                                                             mdata->count);
-					if (rpc_nfs3_read_async(nfs->rpc,
+					if (rpc_nfs3_read_into_async(nfs->rpc,
                                                                 nfs3_pread_mcb,
-                                                                &args, mdata)
+                                                                &args,
+                                                                nfs3_pread_dest(data, mdata),
+                                                                mdata)
                                             == 0) {
 						data->num_calls++;
 						return;
@@ -4588,7 +4618,7 @@ out:
 	}
 
 	cb_err = (int)(data->max_offset - data->org_offset);
-	cb_data = data->buffer + (data->org_offset - data->offset);
+	cb_data = nfs3_pread_result(data, cb_err);
 	data->cb(cb_err, nfs, cb_data, data->private_data);
 	free_nfs_cb_data(data);
 	return;
@@ -4596,8 +4626,8 @@ out:
 
 int
 nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
-                          uint64_t offset, size_t count, nfs_cb cb,
-                          void *private_data, int update_pos)
+                          uint64_t offset, size_t count, char *buf,
+                          nfs_cb cb, void *private_data, int update_pos)
 {
 	struct nfs_cb_data *data;
 
@@ -4615,6 +4645,7 @@ nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
 	data->org_offset   = offset;
 	data->org_count    = (count3)count;
 	data->update_pos   = update_pos;
+	data->dstbuf       = buf;
 
 	assert(data->num_calls == 0);
 
@@ -4657,7 +4688,7 @@ nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
 			if (update_pos) {
 				data->nfsfh->offset = data->org_offset + data->org_count;
 			}
-			data->cb(data->org_count, nfs, data->buffer + (data->org_offset - data->offset), data->private_data);
+			data->cb(data->org_count, nfs, nfs3_pread_result(data, data->org_count), data->private_data);
 			free_nfs_cb_data(data);
 			return 0;
 		}
@@ -4677,6 +4708,14 @@ nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
 		data->count += nfsfh->ra.cur_ra;
 	}
 
+	if (buf != NULL && data->buffer == NULL &&
+	    data->offset == data->org_offset && data->count == data->org_count) {
+		/* nothing to align or read ahead, so the replies can go
+		 * straight into the caller's buffer */
+		data->buffer = buf;
+		data->not_my_buffer = 1;
+	}
+
 	if ((data->count > nfs_get_readmax(nfs) || data->count > data->org_count) &&
 	    (data->buffer == NULL || nfsfh->ra.cur_ra > 0)) {
 		/* we do readahead, a big read or aligned out the request so we
@@ -4719,8 +4758,10 @@ nfs3_pread_async_internal(struct nfs_context *nfs, struct nfsfh *nfsfh,
 
 		nfs3_fill_READ3args(&args, nfsfh, offset, readcount);
 
-		if (rpc_nfs3_read_async(nfs->rpc, nfs3_pread_mcb,
-                                        &args, mdata) != 0) {
+		if (rpc_nfs3_read_into_async(nfs->rpc, nfs3_pread_mcb,
+                                             &args,
+                                             nfs3_pread_dest(data, mdata),
+                                             mdata) != 0) {
 			nfs_set_error(nfs, "RPC error: Failed to send READ "
                                       "call for %s", data->path);
 			free(mdata);
@@ -201,6 +201,11 @@ void rpc_free_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu)
 {
 	assert(rpc->magic == RPC_CONTEXT_MAGIC);
 
+	if (rpc->inplace == pdu) {
+		/* the rest of its reply goes to the ordinary buffer */
+		rpc->inplace = NULL;
+	}
+
 	free(pdu->outdata.data);
 
 	if (pdu->zdr_decode_buf != NULL) {
@@ -217,6 +222,34 @@ void rpc_set_next_xid(struct rpc_context *rpc, uint32_t xid)
 	rpc->xid = xid;
 }
 
+/*
+ * Encode len as the length of an opaque<> but leave its body in buf instead
+ * of copying it into the encode buffer. The body and its padding are sent
+ * after everything encoded so far, so it has to be the last item of the call.
+ * buf must stay valid until the pdu has completed or been freed.
+ * Only for stream transports, a datagram has to go out in one piece.
+ */
+int rpc_pdu_add_payload(struct rpc_pdu *pdu, char *buf, uint32_t len)
+{
+	if (pdu->payload.data != NULL) {
+		return -1;
+	}
+	if (!zdr_u_int(&pdu->zdr, &len)) {
+		return -1;
+	}
+	pdu->payload.data = buf;
+	pdu->payload.size = (int)len;
+	return 0;
+}
+
+/* Number of bytes that go out on the wire for a queued pdu */
+uint32_t rpc_pdu_out_size(struct rpc_pdu *pdu)
+{
+	uint32_t len = (uint32_t)pdu->payload.size;
+
+	return (uint32_t)pdu->outdata.size + len + ((4 - (len & 3)) & 3);
+}
+
 int rpc_queue_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu)
 {
 	int size, recordmarker;
@@ -245,6 +278,8 @@ int rpc_queue_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu)
 	if (rpc->is_udp != 0) {
 		unsigned int hash;
 
+		assert(pdu->payload.data == NULL);
+
 // XXX add a rpc->udp_dest_sock_size  and get rid of sys/socket.h and netinet/in.h
 		if (sendto(rpc->fd, pdu->zdr.buf, size, MSG_DONTWAIT,
                            (struct sockaddr *)&rpc->udp_dest,
@@ -260,17 +295,104 @@ int rpc_queue_pdu(struct rpc_context *rpc, struct rpc_pdu *pdu)
 		return 0;
 	}
 
+	pdu->outdata.size = size;
+
 	/* write recordmarker */
 	zdr_setpos(&pdu->zdr, 0);
-	recordmarker = (size - 4) | 0x80000000;
+	recordmarker = (rpc_pdu_out_size(pdu) - 4) | 0x80000000;
 	zdr_int(&pdu->zdr, &recordmarker);
 
-	pdu->outdata.size = size;
 	rpc_enqueue(&rpc->outqueue, pdu);
 
 	return 0;
 }
 
+/* longest opaque_auth body allowed by RFC 5531 */
+#define RPC_MAX_AUTH_BYTES 400
+
+static uint32_t rpc_get_u32(const char *buf)
+{
+	uint32_t val;
+
+	memcpy(&val, buf, 4);
+	return ntohl(val);
+}
+
+/*
+ * Called with the first len bytes of a size byte record as they arrive, to
+ * see if it is a reply whose data the call asked to be placed in a buffer of
+ * its own. Returns how many bytes of the record have to be read before that
+ * can be told, or 0 once it is decided; a record shorter than that is not
+ * placed. If the data is to be placed,
+ * rpc->inplace is set to the call and the data starts rpc->inplace_pos
+ * bytes into the record. Nothing past that has to be read to find out, so
+ * the data can be received straight into pdu->indata.
+ */
+uint32_t rpc_place_reply(struct rpc_context *rpc, const char *buf, uint32_t len, uint32_t size)
+{
+	struct rpc_pdu *pdu;
+	uint32_t xid, pos, vlen, off, count;
+	int ret;
+
+	rpc->inplace = NULL;
+
+	/* record marker, xid, direction and reply_stat */
+	if (len < 16) {
+		return 16;
+	}
+	if (!(rpc_get_u32(buf) & 0x80000000) || rpc->fragments != NULL) {
+		return 0;
+	}
+	xid = rpc_get_u32(buf + 4);
+	for (pdu = rpc->waitpdu[rpc_hash_xid(xid)].head; pdu; pdu = pdu->next) {
+		if (pdu->xid == xid) {
+			break;
+		}
+	}
+	if (pdu == NULL || pdu->place_fn == NULL ||
+	    rpc_get_u32(buf + 8) != REPLY ||
+	    rpc_get_u32(buf + 12) != MSG_ACCEPTED) {
+		return 0;
+	}
+
+	/* verifier */
+	if (len < 24) {
+		return 24;
+	}
+	vlen = rpc_get_u32(buf + 20);
+	if (vlen > RPC_MAX_AUTH_BYTES) {
+		return 0;
+	}
+	pos = 24 + ((vlen + 3) & ~3);
+
+	/* accept_stat */
+	if (len < pos + 4) {
+		return pos + 4;
+	}
+	if (rpc_get_u32(buf + pos) != SUCCESS) {
+		return 0;
+	}
+	pos += 4;
+
+	ret = pdu->place_fn(buf + pos, len - pos, &off, &count);
+	if (ret < 0) {
+		return 0;
+	}
+	if (ret > 0) {
+		return pos + ret;
+	}
+	pos += off;
+	if (pos != len || count > (uint32_t)pdu->indata.size ||
+	    pos + ((count + 3) & ~3) != size) {
+		return 0;
+	}
+
+	rpc->inplace = pdu;
+	rpc->inplace_pos = pos;
+	rpc->inplace_len = count;
+	return 0;
+}
+
 uint32_t rpc_get_pdu_size(char *buf)
 {
 	uint32_t size;
@@ -567,6 +689,11 @@ int rpc_process_pdu(struct rpc_context *rpc, char *buf, int size)
 				prev_pdu->next = pdu->next;
 			rpc->waitpdu_len--;
 		}
+		if (rpc->inplace == pdu && reasbuf == NULL) {
+			/* its data was received into pdu->indata */
+			zdr.placed = pdu->indata.data;
+			zdr.placed_pos = rpc->inplace_pos;
+		}
 		if (rpc_process_reply(rpc, pdu, &zdr) != 0) {
 			rpc_set_error(rpc, "rpc_procdess_reply failed");
 		}
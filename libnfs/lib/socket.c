@@ -218,12 +218,27 @@ rpc_write_to_socket(struct rpc_context *rpc)
 	}
 
 	while ((pdu = rpc->outqueue.head) != NULL) {
-		int64_t total;
-
-		total = pdu->outdata.size;
+		static char padding[4];
+		int64_t end;
+		uint32_t payload_end;
+		char *buf;
+
+		/* the encoded call, then the payload it references,
+		 * then the payload's padding */
+		payload_end = pdu->outdata.size + pdu->payload.size;
+		if (pdu->written < (uint32_t)pdu->outdata.size) {
+			buf = pdu->outdata.data + pdu->written;
+			end = pdu->outdata.size;
+		} else if (pdu->written < payload_end) {
+			buf = pdu->payload.data + (pdu->written - pdu->outdata.size);
+			end = payload_end;
+		} else {
+			buf = padding;
+			end = rpc_pdu_out_size(pdu);
+		}
 
-		count = send(rpc->fd, pdu->outdata.data + pdu->written,
-                             (int)(total - pdu->written), MSG_NOSIGNAL);
+		count = send(rpc->fd, buf,
+                             (int)(end - pdu->written), MSG_NOSIGNAL);
 		if (count == -1) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
 				return 0;
@@ -234,7 +249,7 @@ rpc_write_to_socket(struct rpc_context *rpc)
 		}
 
 		pdu->written += count;
-		if (pdu->written == total) {
+		if (pdu->written == rpc_pdu_out_size(pdu)) {
 			unsigned int hash;
 
 			rpc->outqueue.head = pdu->next;
@@ -261,6 +276,8 @@ rpc_read_from_socket(struct rpc_context *rpc)
 	uint32_t pdu_size;
 	ssize_t count;
 	char *buf;
+	char *dst;
+	uint32_t want;
 
 	assert(rpc->magic == RPC_CONTEXT_MAGIC);
 
@@ -321,12 +338,32 @@ rpc_read_from_socket(struct rpc_context *rpc)
 					return -1;
 				}
 				memcpy(rpc->inbuf, &rpc->rm_buf, 4);
+				rpc->inplace_checked = 0;
+				rpc->inplace = NULL;
 			}
 			buf = rpc->inbuf;
 		}
 
-		count = recv(rpc->fd, buf + rpc->inpos, pdu_size - rpc->inpos,
-                             MSG_DONTWAIT);
+		dst = buf + rpc->inpos;
+		want = pdu_size - rpc->inpos;
+		if (rpc->inpos >= 4 && !rpc->inplace_checked) {
+			/* read no further than needed to tell whether the
+			 * data can go straight to its destination */
+			uint32_t need = rpc_place_reply(rpc, buf, rpc->inpos, pdu_size);
+			if (need == 0 || need > pdu_size) {
+				rpc->inplace_checked = 1;
+			} else {
+				want = need - rpc->inpos;
+			}
+		}
+		if (rpc->inplace != NULL &&
+		    rpc->inpos >= rpc->inplace_pos &&
+		    rpc->inpos < rpc->inplace_pos + rpc->inplace_len) {
+			dst = rpc->inplace->indata.data + (rpc->inpos - rpc->inplace_pos);
+			want = rpc->inplace_pos + rpc->inplace_len - rpc->inpos;
+		}
+
+		count = recv(rpc->fd, dst, want, MSG_DONTWAIT);
 		if (count < 0) {
 			if (errno == EINTR || errno == EAGAIN) {
 				break;
@@ -355,9 +392,11 @@ rpc_read_from_socket(struct rpc_context *rpc)
 				rpc_set_error(rpc, "Invalid/garbage pdu "
                                               "received from server. Closing "
                                               "socket");
+				rpc->inplace = NULL;
 				free(buf);
 				return -1;
 			}
+			rpc->inplace = NULL;
 			free(buf);
 		}
 	} while (rpc->is_nonblocking && rpc->waitpdu_len > 0);
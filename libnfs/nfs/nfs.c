@@ -271,7 +271,49 @@ int rpc_nfs_access_async(struct rpc_context *rpc, rpc_cb cb, struct nfs_fh3 *fh,
 	return rpc_nfs3_access_async(rpc, cb, &args, private_data);
 }
 
+/* encoded size of a fattr3 */
+#define NFS3_FATTR3_SIZE 84
+
+/* Finds the data of a READ3res, see rpc_place_reply() */
+static int nfs3_read_place(const char *res, uint32_t len, uint32_t *pos, uint32_t *count)
+{
+	ZDR zdr;
+	uint32_t status, follows;
+	uint32_t off = 8;
+	int ret = 0;
+
+	/* status and whether attributes follow */
+	if (len < off)
+		return off;
+	zdrmem_create(&zdr, (char *)res, len, ZDR_DECODE);
+	zdr_u_int(&zdr, &status);
+	zdr_u_int(&zdr, &follows);
+	if (status != NFS3_OK) {
+		ret = -1;
+		goto out;
+	}
+	if (follows)
+		off += NFS3_FATTR3_SIZE;
+
+	/* then count, eof and the length of the data */
+	if (len < off + 12) {
+		ret = off + 12;
+		goto out;
+	}
+	zdr_setpos(&zdr, off + 8);
+	zdr_u_int(&zdr, count);
+	*pos = off + 12;
+out:
+	zdr_destroy(&zdr);
+	return ret;
+}
+
 int rpc_nfs3_read_async(struct rpc_context *rpc, rpc_cb cb, struct READ3args *args, void *private_data)
+{
+	return rpc_nfs3_read_into_async(rpc, cb, args, NULL, private_data);
+}
+
+int rpc_nfs3_read_into_async(struct rpc_context *rpc, rpc_cb cb, struct READ3args *args, char *buf, void *private_data)
 {
 	struct rpc_pdu *pdu;
 
@@ -287,6 +329,12 @@ int rpc_nfs3_read_async(struct rpc_context *rpc, rpc_cb cb, struct READ3args *ar
 		return -2;
 	}
 
+	if (buf != NULL) {
+		pdu->indata.data = buf;
+		pdu->indata.size = (int)args->count;
+		pdu->place_fn = nfs3_read_place;
+	}
+
 	if (rpc_queue_pdu(rpc, pdu) != 0) {
 		rpc_set_error(rpc, "Out of memory. Failed to queue pdu for NFS3/READ call");
 		return -3;
@@ -308,17 +356,39 @@ int rpc_nfs_read_async(struct rpc_context *rpc, rpc_cb cb, struct nfs_fh3 *fh, u
 	return rpc_nfs3_read_async(rpc, cb, &args, private_data);
 }
 
+/* WRITE3args without copying the data, see rpc_pdu_add_payload() */
+static uint32_t zdr_WRITE3args_payload(struct rpc_pdu *pdu, WRITE3args *args)
+{
+	if (!zdr_nfs_fh3(&pdu->zdr, &args->file))
+		return FALSE;
+	if (!zdr_offset3(&pdu->zdr, &args->offset))
+		return FALSE;
+	if (!zdr_count3(&pdu->zdr, &args->count))
+		return FALSE;
+	if (!zdr_stable_how(&pdu->zdr, &args->stable))
+		return FALSE;
+	return rpc_pdu_add_payload(pdu, args->data.data_val, args->data.data_len) == 0;
+}
+
 int rpc_nfs3_write_async(struct rpc_context *rpc, rpc_cb cb, struct WRITE3args *args, void *private_data)
 {
 	struct rpc_pdu *pdu;
+	uint32_t encoded;
 
-	pdu = rpc_allocate_pdu2(rpc, NFS_PROGRAM, NFS_V3, NFS3_WRITE, cb, private_data, (zdrproc_t)zdr_WRITE3res, sizeof(WRITE3res), args->count);
+	/* over tcp the data is sent from the caller's buffer, which
+	 * must then stay valid until cb has been called */
+	pdu = rpc_allocate_pdu2(rpc, NFS_PROGRAM, NFS_V3, NFS3_WRITE, cb, private_data, (zdrproc_t)zdr_WRITE3res, sizeof(WRITE3res), rpc->is_udp ? args->count : 0);
 	if (pdu == NULL) {
 		rpc_set_error(rpc, "Out of memory. Failed to allocate pdu for NFS3/WRITE call");
 		return -1;
 	}
 
-	if (zdr_WRITE3args(&pdu->zdr, args) == 0) {
+	if (rpc->is_udp) {
+		encoded = zdr_WRITE3args(&pdu->zdr, args);
+	} else {
+		encoded = zdr_WRITE3args_payload(pdu, args);
+	}
+	if (encoded == 0) {
 		rpc_set_error(rpc, "ZDR error: Failed to encode WRITE3args");
 		rpc_free_pdu(rpc, pdu);
 		return -2;
@@ -11,6 +11,7 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sel4/sel4.h>
 #include <clock/device.h>
@@ -25,11 +26,19 @@
 #define CLOCK_R_FAIL (-3)       /* operation failed for other reason */
 
 
-/* this needs to be larger than MAX_PROCS */
-#define MAX_TIMER_ID 32
+/* this bounds the number of concurrently sleeping processes */
+#define MAX_TIMER_ID 4096
+
+/* Resolution of the timer wheel */
+#define TIMER_TICK_US  100
+/* Deadlines within this much of each other may be served by one interrupt.
+ * Timers fire at most TIMER_SLACK_US + TIMER_TICK_US late, never early. */
+#define TIMER_SLACK_US 1000
 
 typedef uint64_t timestamp_t;
-typedef void (*timer_callback_t)(uint32_t id, seL4_Word data1, seL4_Word data2);
+/* Returns false if the expiry cannot be delivered yet. The timer then stays
+ * expired and its callback is retried on the next timer_irq. */
+typedef bool (*timer_callback_t)(uint32_t id, seL4_Word data1, seL4_Word data2);
 
 
 /*
@@ -44,7 +53,7 @@ int start_timer(unsigned char *timer_vaddr);
 /**
  * Get the current clock time in microseconds.
  */
-timestamp_t get_time(void);
+timestamp_t clock_get_time(void);
 
 /**
  * Register a callback to be called after a given delay
@@ -18,6 +18,33 @@
 
 #define TIMER_REG_START   0x940    // TIMER_MUX
 
+/* Timer E, the free running timestamp, as offsets into the page at TIMER_MAP_BASE */
+#define TIMER_E_OFFSET    (TIMER_REG_START + 0x48)
+#define TIMER_E_HI_OFFSET (TIMER_REG_START + 0x4c)
+
+/**
+ * Read the 64-bit timestamp (timer E) straight off a mapping of the timer
+ * page. Only needs read access, so it also works on read-only mappings.
+ *
+ * @param page  Virtual address the page at TIMER_MAP_BASE is mapped at.
+ * @return      The current value of the timestamp.
+ */
+static inline uint64_t meson_timestamp(void *page)
+{
+    volatile uint32_t *lo_reg = (volatile uint32_t *)((uintptr_t) page + TIMER_E_OFFSET);
+    volatile uint32_t *hi_reg = (volatile uint32_t *)((uintptr_t) page + TIMER_E_HI_OFFSET);
+
+    uint64_t lo = *lo_reg;
+    uint64_t hi = *hi_reg;
+    uint64_t new_lo = *lo_reg;
+    /* the low word wrapped between the two reads */
+    if (new_lo < lo) {
+        lo = new_lo;
+        hi = *hi_reg;
+    }
+    return (hi << 32) | lo;
+}
+
 /**
  * Identifiers for each of the timeout timers.
  *
@@ -0,0 +1,40 @@
+/*
+ * Expiry ring shared between the clock driver and SOS.
+ *
+ * A single page, owned by SOS and mapped into the clock driver at
+ * TIMER_RING_VADDR. The driver writes an entry for every timer that fires
+ * and signals the notification in TIMER_RING_NTFN_SLOT once per batch; SOS
+ * drains everything up to tail when it sees the signal. Each side only moves
+ * its own index, both run freely and wrap modulo TIMER_RING_ENTRIES.
+ *
+ * If the ring is full the driver keeps the rest of its expiries and sets
+ * stalled. SOS kicks the driver after draining a stalled ring, the same way
+ * it does on a timer IRQ.
+ */
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <sel4/sel4.h>
+#include <utils/util.h>
+
+#define TIMER_RING_VADDR     (0xC000001000)
+/* slot clock_hook puts the notification in, after the endpoint and reply */
+#define TIMER_RING_NTFN_SLOT 4
+#define TIMER_RING_ENTRIES   128
+
+typedef struct {
+    seL4_Word id;
+    seL4_Word data1;
+    seL4_Word data2;
+} timer_expiry_t;
+
+typedef struct {
+    volatile uint32_t head;     /* next entry SOS reads */
+    volatile uint32_t tail;     /* next entry the driver writes */
+    volatile uint32_t stalled;  /* driver has expiries waiting for room */
+    timer_expiry_t entries[TIMER_RING_ENTRIES];
+} timer_ring_t;
+
+compile_time_assert("timer ring fits in a page", sizeof(timer_ring_t) <= PAGE_SIZE_4K);
+compile_time_assert("timer ring entries power of 2", (TIMER_RING_ENTRIES & (TIMER_RING_ENTRIES - 1)) == 0);
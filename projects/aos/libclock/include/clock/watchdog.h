@@ -67,3 +67,13 @@ static inline void watchdog_reset(void)
     RAW_WRITE32(0, wdog + WDOG_RESET);
     COMPILER_MEMORY_FENCE();
 }
+
+/* Change the expiry and restart the count, the next IRQ comes timeout_us from now */
+static inline void watchdog_set(uint16_t timeout_us)
+{
+    ZF_LOGF_IF(wdog == NULL, "WDOG uninitialised!");
+
+    RAW_WRITE32(timeout_us, wdog + WDOG_TCNT);
+    RAW_WRITE32(0, wdog + WDOG_RESET);
+    COMPILER_MEMORY_FENCE();
+}
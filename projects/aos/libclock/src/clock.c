@@ -0,0 +1,201 @@
+/*
+ * Copyright 2019, Data61
+ * Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+ * ABN 41 687 119 230.
+ *
+ * This software may be distributed and modified according to the terms of
+ * the GNU General Public License version 2. Note that NO WARRANTY is provided.
+ * See "LICENSE_GPLv2.txt" for details.
+ *
+ * @TAG(DATA61_GPL)
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <clock/clock.h>
+#include <clock/device.h>
+#include <sel4/sel4.h>
+#include <stdbool.h>
+
+#include "device.h"
+
+#include "utils/rolling_id.h"
+#include "utils/timer_wheel.h"
+
+struct timer {
+    /* must stay first, the wheel hands us back this */
+    tw_timer_t node;
+    uint32_t id;
+    timer_callback_t callback;
+    seL4_Word data1;
+    seL4_Word data2;
+};
+
+static bool timer_inused[MAX_TIMER_ID + 1];
+
+static struct {
+    volatile meson_timer_reg_t *regs;
+    /* Add fields as you see necessary */
+    tw_t wheel;
+    rid_t timer_ids;
+    /* deadline timer A is programmed for, 0 if it is idle */
+    timestamp_t armed;
+    /* expired timers whose callback could not take them yet, oldest first */
+    tw_timer_t *backlog;
+    tw_timer_t *backlog_tail;
+} clock;
+
+static bool timer_enabled = false;
+
+static struct timer timers[MAX_TIMER_ID + 1];
+
+int start_timer(unsigned char *timer_vaddr)
+{
+    int err = stop_timer();
+    if (err != 0) {
+        return err;
+    }
+
+    clock.regs = (meson_timer_reg_t *)(timer_vaddr + TIMER_REG_START);
+
+    rid_init(&(clock.timer_ids), timer_inused, MAX_TIMER_ID, 1);
+    for (int i = 0; i <= MAX_TIMER_ID; i++) timers[i].node.level = -1;
+
+    configure_timestamp(clock.regs, TIMESTAMP_TIMEBASE_1_US);
+    tw_init(&(clock.wheel), TIMER_TICK_US, TIMER_SLACK_US, clock_get_time());
+    clock.armed = 0;
+    clock.backlog = clock.backlog_tail = NULL;
+    timer_enabled = true;
+
+    return CLOCK_R_OK;
+}
+
+timestamp_t clock_get_time(void) {
+    return read_timestamp(clock.regs);
+}
+
+/* Program timer A for when the wheel next needs attention. With force unset
+ * this only ever moves the interrupt earlier, so inserting a timer behind
+ * the head or cancelling one costs no register writes. */
+static void update_timer(bool force) {
+    timestamp_t deadline;
+    if (!tw_next(&(clock.wheel), &deadline)) {
+        if (force && clock.armed) {
+            configure_timeout(clock.regs, MESON_TIMER_A, false, false, 0, 0);
+            clock.armed = 0;
+        }
+        return;
+    }
+    if (!force && clock.armed && clock.armed <= deadline) return;
+
+    timestamp_t current_time = clock_get_time();
+    uint64_t remaining_time = deadline > current_time ? deadline - current_time : 0;
+    timestamp_timebase_t timebase;
+
+    if (remaining_time <= UINT16_MAX) {
+        timebase = TIMEOUT_TIMEBASE_1_US;
+    } else if (remaining_time <= 10 * UINT16_MAX) {
+        remaining_time /= 10;
+        timebase = TIMEOUT_TIMEBASE_10_US;
+    } else if (remaining_time <= 100 * UINT16_MAX) {
+        remaining_time /= 100;
+        timebase = TIMEOUT_TIMEBASE_100_US;
+    } else if (remaining_time <= 1000 * UINT16_MAX) {
+        remaining_time /= 1000;
+        timebase = TIMEOUT_TIMEBASE_1_MS;
+    } else {
+        /* too far out, wake up at the limit and program it again */
+        remaining_time = UINT16_MAX;
+        timebase = TIMEOUT_TIMEBASE_1_MS;
+    }
+
+    configure_timeout(clock.regs, MESON_TIMER_A, true, false, timebase, remaining_time);
+    clock.armed = deadline;
+}
+
+uint32_t register_timer(uint64_t delay, timer_callback_t callback, seL4_Word data1, seL4_Word data2)
+{
+    int id = rid_get_id(&(clock.timer_ids));
+    if (id < 0) return 0;
+
+    struct timer *timer = timers + id;
+    timer->callback = callback;
+    timer->data1 = data1;
+    timer->data2 = data2;
+    timer->id = id;
+
+    tw_add(&(clock.wheel), &(timer->node), clock_get_time() + delay);
+
+    update_timer(false);
+
+    return id;
+}
+
+/* Take node off the backlog, returns false if it is not on it */
+static bool backlog_remove(tw_timer_t *node) {
+    tw_timer_t *prev = NULL;
+    for (tw_timer_t *t = clock.backlog; t != NULL; prev = t, t = t->next) {
+        if (t != node) continue;
+        if (prev) prev->next = t->next;
+        else clock.backlog = t->next;
+        if (clock.backlog_tail == t) clock.backlog_tail = prev;
+        return true;
+    }
+    return false;
+}
+
+int remove_timer(uint32_t id)
+{
+    if (id == 0 || id > MAX_TIMER_ID) return CLOCK_R_FAIL;
+
+    struct timer *timer = timers + id;
+    if (tw_pending(&(timer->node))) {
+        tw_cancel(&(clock.wheel), &(timer->node));
+    } else if (!rid_is_inused(&(clock.timer_ids), id) || !backlog_remove(&(timer->node))) {
+        /* its callback has run already and the id may have been handed
+         * out again, so there is nothing of the caller's left to remove */
+        return CLOCK_R_FAIL;
+    }
+    rid_remove_id(&(clock.timer_ids), id);
+
+    return CLOCK_R_OK;
+}
+
+int timer_irq() {
+    /* everything that is due goes out in one batch, behind whatever is
+     * still left over from the last one */
+    tw_timer_t *expired = tw_expire(&(clock.wheel), clock_get_time());
+    while (expired != NULL) {
+        tw_timer_t *node = expired;
+        expired = node->next;
+        node->next = NULL;
+        if (clock.backlog_tail) clock.backlog_tail->next = node;
+        else clock.backlog = node;
+        clock.backlog_tail = node;
+    }
+
+    while (clock.backlog != NULL) {
+        struct timer *timer = (struct timer *) clock.backlog;
+        if (!timer->callback(timer->id, timer->data1, timer->data2)) break;
+        clock.backlog = timer->node.next;
+        if (clock.backlog == NULL) clock.backlog_tail = NULL;
+        rid_remove_id(&(clock.timer_ids), timer->id);
+    }
+
+    update_timer(true);
+    return CLOCK_R_OK;
+}
+
+int stop_timer(void)
+{
+    /* Stop the timer from producing further interrupts and remove all
+     * existing timeouts */
+    if (timer_enabled) {
+        configure_timeout(clock.regs, MESON_TIMER_A, false, false, 0, 0);
+        configure_timestamp(clock.regs, TIMESTAMP_TIMEBASE_SYSTEM);
+        rid_destroy(&(clock.timer_ids));
+        timer_enabled = false;
+    }
+
+    return CLOCK_R_OK;
+}
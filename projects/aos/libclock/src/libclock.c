@@ -1 +0,0 @@
-// ceebs to figure out how to configure header-only library
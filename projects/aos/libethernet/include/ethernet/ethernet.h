@@ -11,6 +11,7 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /**
@@ -47,18 +48,33 @@ typedef struct {
     uintptr_t (*dma_phys_to_virt)(uintptr_t phys);
     uint32_t (*flush_dcache_range)(uintptr_t addr, size_t size);
     uint32_t (*invalidate_dcache_range)(uintptr_t addr, size_t size);
+    /* optional, returns 0 if virt is not DMA memory. Needed for ethif_send_zerocopy */
+    uintptr_t (*dma_virt_to_phys)(uintptr_t virt);
 } ethif_dma_ops_t;
 
 /**
- * Called by ethernet driver when a frame is received (inside an ethif_recv())
+ * Hands a received buffer that was loaned out back to the driver.
+ */
+typedef void (*ethif_release_t)(uint8_t *in_packet);
+
+/**
+ * Called by ethernet driver when a frame is received (inside an ethif_recv() or ethif_poll())
  * This function must be defined by code which uses this driver, and passed into ethif_init.
  *
  * See ethif_recv for more information.
  *
- * @param in_packet packet received - *must* be copied in this function, memory will be re-used later
+ * @param in_packet packet received
  * @param len       length of received packet
+ * @param release   if not NULL, the buffer is on loan: it may be kept after the callback returns,
+ *                  and must be given back exactly once through release. If NULL, in_packet *must*
+ *                  be copied in this function, the memory will be re-used later
+ */
+typedef void (*ethif_recv_callback_t)(uint8_t *in_packet, int len, ethif_release_t release);
+
+/**
+ * Called once a frame passed to ethif_send_zerocopy has left the device.
  */
-typedef void (*ethif_recv_callback_t)(uint8_t *in_packet, int len);
+typedef void (*ethif_tx_done_t)(void *cookie);
 
 /**
  * Initialise the ethernet interface.
@@ -84,6 +100,18 @@ ethif_err_t ethif_init(uint64_t base_addr, uint8_t mac_out[6], ethif_dma_ops_t *
  */
 ethif_err_t ethif_send(uint8_t *buf, uint32_t len);
 
+/**
+ * Like ethif_send, but the device reads the frame straight from buf. buf must be DMA memory
+ * (see dma_virt_to_phys) and stay untouched until done(cookie) is called.
+ *
+ * @param buf    frame contents to send, at least 60 bytes
+ * @param len    length of buffer to send
+ * @param done   called when the device is finished with buf
+ * @param cookie passed to done
+ * @return ETHIF_ERROR if buf cannot be sent without a copy or the transmit ring is full
+ */
+ethif_err_t ethif_send_zerocopy(uint8_t *buf, uint32_t len, ethif_tx_done_t done, void *cookie);
+
 /**
  * Poll the receive buffers for a packet.
  *
@@ -97,4 +125,23 @@ ethif_err_t ethif_send(uint8_t *buf, uint32_t len);
  */
 ethif_err_t ethif_recv(int *len);
 
+/**
+ * Receive up to budget frames, and reclaim transmit descriptors the device is done with.
+ *
+ * Receive interrupts are masked by ethif_irq and only unmasked again once a poll finds the
+ * receive ring empty, so a burst of frames is taken in by polling rather than an IRQ each.
+ *
+ * @param budget  maximum number of frames to receive
+ * @return number of frames received. If that is budget, frames may be left, see ethif_rx_pending
+ */
+int ethif_poll(int budget);
+
+/**
+ * @return true if the last ethif_poll ran out of budget, and receive interrupts are still masked
+ */
+bool ethif_rx_pending(void);
+
+/**
+ * Acknowledge an interrupt from the MAC. Call on every ethernet IRQ, before polling.
+ */
 void ethif_irq(void);
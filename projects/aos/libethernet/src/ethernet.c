@@ -44,9 +44,43 @@ ethif_err_t ethif_recv(int *len)
     return ETHIF_ERROR;
 }
 
-void uboot_process_received_packet(uint8_t *in_packet, int len)
+int designware_send_zerocopy(struct eth_device *dev, void *packet, ulong paddr, int length,
+                             ethif_tx_done_t done, void *cookie);
+ethif_err_t ethif_send_zerocopy(uint8_t *buf, uint32_t len, ethif_tx_done_t done, void *cookie)
 {
-    ethif_recv_callback(in_packet, len);
+    assert(buf);
+    assert(done);
+    if (dma_ops.dma_virt_to_phys == NULL) {
+        return ETHIF_ERROR;
+    }
+    uintptr_t paddr = dma_ops.dma_virt_to_phys((uintptr_t) buf);
+    if (paddr == 0) {
+        return ETHIF_ERROR;
+    }
+    return (designware_send_zerocopy(&uboot_eth_dev, buf, paddr, len, done, cookie) == 0) ? ETHIF_NOERROR : ETHIF_ERROR;
+}
+
+int designware_poll(struct eth_device *dev, int budget);
+int ethif_poll(int budget)
+{
+    return designware_poll(&uboot_eth_dev, budget);
+}
+
+bool designware_rx_pending(struct eth_device *dev);
+bool ethif_rx_pending(void)
+{
+    return designware_rx_pending(&uboot_eth_dev);
+}
+
+void designware_release(struct eth_device *dev, uchar *packet);
+static void ethif_release(uint8_t *in_packet)
+{
+    designware_release(&uboot_eth_dev, in_packet);
+}
+
+void uboot_process_received_packet(uint8_t *in_packet, int len, bool loaned)
+{
+    ethif_recv_callback(in_packet, len, loaned ? ethif_release : NULL);
 }
 
 ethif_dma_ops_t *uboot_get_dma_ops()
@@ -14,6 +14,7 @@
 
 #include "common.h"
 #include "net.h"
+#include <assert.h>
 #include <errno.h>
 #include "miiphy.h"
 #include <malloc.h>
@@ -202,6 +203,9 @@ static void tx_descs_init(struct dw_eth_dev *priv)
 
 	writel((ulong)&desc_table_pptr[0], &dma_p->txdesclistaddr);
 	priv->tx_currdescnum = 0;
+	priv->tx_dirtydescnum = 0;
+	priv->tx_inflight = 0;
+	priv->tx_unsignalled = 0;
 }
 
 static void rx_descs_init(struct dw_eth_dev *priv)
@@ -230,10 +234,16 @@ static void rx_descs_init(struct dw_eth_dev *priv)
 		desc_p->dmamac_cntl =
 			(MAC_MAX_FRAME_SZ & DESC_RXCTRL_SIZE1MASK) |
 				      DESC_RXCTRL_RXCHAIN;
+		if (priv->rx_coalesce)
+			desc_p->dmamac_cntl |= DESC_RXCTRL_RXINTDIS;
 
 		desc_p->txrx_status = DESC_RXSTS_OWNBYDMA;
 	}
 
+	/* The buffers past the ring are spare */
+	for (priv->rx_nfree = 0; idx < RX_BUFF_NUM; idx++)
+		priv->rx_free[priv->rx_nfree++] = idx;
+
 	/* Correcting the last pointer of the chain */
 	desc_p->dmamac_next = (ulong)&desc_table_pptr[0];
 
@@ -341,6 +351,15 @@ int designware_eth_init(struct dw_eth_dev *priv, u8 *enetaddr)
 	 */
 	_dw_write_hwaddr(priv, enetaddr);
 
+	/*
+	 * Moderate RX interrupts with the receive watchdog, if the core has
+	 * one: frames stop interrupting on their own and the watchdog fires
+	 * once no frame has come in for a while.
+	 */
+	writel(CONFIG_DW_RX_RIWT, &dma_p->riwt);
+	priv->rx_coalesce = CONFIG_DW_RX_RIWT != 0 &&
+			    readl(&dma_p->riwt) == CONFIG_DW_RX_RIWT;
+
 	rx_descs_init(priv);
 	tx_descs_init(priv);
 
@@ -396,7 +415,45 @@ int designware_eth_enable(struct dw_eth_dev *priv)
 
 #define ETH_ZLEN	60
 
-static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
+/* Give back the descriptors the DMA is finished with */
+static void _dw_tx_reclaim(struct dw_eth_dev *priv)
+{
+	while (priv->tx_inflight > 0) {
+		u32 desc_num = priv->tx_dirtydescnum;
+		struct dmamacdescr *desc_vptr = &((struct dmamacdescr*)priv->tx_mac_descrtable.vaddr)[desc_num];
+		ulong desc_vstart = (ulong)desc_vptr;
+		ulong desc_vend = desc_vstart +
+			roundup(sizeof(*desc_vptr), ARCH_DMA_MINALIGN);
+		ethif_tx_done_t done = priv->tx_done[desc_num];
+
+		uboot_invalidate_dcache_range(desc_vstart, desc_vend);
+		if (desc_vptr->txrx_status & DESC_TXSTS_OWNBYDMA)
+			break;
+
+		priv->tx_done[desc_num] = NULL;
+		if (++priv->tx_dirtydescnum >= CONFIG_TX_DESCR_NUM)
+			priv->tx_dirtydescnum = 0;
+		priv->tx_inflight--;
+
+		if (done)
+			done(priv->tx_cookie[desc_num]);
+	}
+}
+
+/* Reclaim what we can, returns true if the TX ring is still full */
+static bool _dw_tx_full(struct dw_eth_dev *priv)
+{
+	_dw_tx_reclaim(priv);
+	if (priv->tx_inflight < CONFIG_TX_DESCR_NUM)
+		return false;
+
+	printf("CPU not owner of tx frame\n");
+	return true;
+}
+
+/* Hand the next descriptor to the DMA, pointing at the frame at data_pstart */
+static int _dw_eth_xmit(struct dw_eth_dev *priv, ulong data_pstart, int length,
+			ethif_tx_done_t done, void *cookie)
 {
 	struct eth_dma_regs *dma_p = priv->dma_regs_p;
 	u32 desc_num = priv->tx_currdescnum;
@@ -404,33 +461,26 @@ static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
 	ulong desc_vstart = (ulong)desc_vptr;
 	ulong desc_vend = desc_vstart +
 		roundup(sizeof(*desc_vptr), ARCH_DMA_MINALIGN);
-	ulong data_vstart = uboot_dma_phys_to_virt(desc_vptr->dmamac_addr);
-	ulong data_vend = data_vstart + roundup(length, ARCH_DMA_MINALIGN);
+	bool irq;
+
 	/*
-	 * Strictly we only need to invalidate the "txrx_status" field
-	 * for the following check, but on some platforms we cannot
-	 * invalidate only 4 bytes, so we flush the entire descriptor,
-	 * which is 16 bytes in total. This is safe because the
-	 * individual descriptors in the array are each aligned to
-	 * ARCH_DMA_MINALIGN and padded appropriately.
+	 * Completions are reaped by polling, so only interrupt every so
+	 * often, and when the ring fills up so that it drains in time.
 	 */
-	uboot_invalidate_dcache_range(desc_vstart, desc_vend);
+	irq = ++priv->tx_unsignalled >= CONFIG_DW_TX_COALESCE ||
+	      priv->tx_inflight + 1 == CONFIG_TX_DESCR_NUM;
+	if (irq)
+		priv->tx_unsignalled = 0;
 
-	/* Check if the descriptor is owned by CPU */
-	if (desc_vptr->txrx_status & DESC_TXSTS_OWNBYDMA) {
-		printf("CPU not owner of tx frame\n");
-		return -EPERM;
-	}
-
-	length = max(length, ETH_ZLEN);
-
-	memcpy((void *)data_vstart, packet, length);
-
-	/* Flush data to be sent */
-	uboot_flush_dcache_range(data_vstart, data_vend);
+	desc_vptr->dmamac_addr = data_pstart;
+	priv->tx_done[desc_num] = done;
+	priv->tx_cookie[desc_num] = cookie;
 
 #if defined(CONFIG_DW_ALTDESCRIPTOR)
-	desc_vptr->txrx_status |= DESC_TXSTS_TXFIRST | DESC_TXSTS_TXLAST;
+	desc_vptr->txrx_status &= ~DESC_TXSTS_TXINT;
+	desc_vptr->txrx_status |= DESC_TXSTS_TXFIRST | DESC_TXSTS_TXLAST |
+				  (irq ? DESC_TXSTS_TXINT : 0);
+	desc_vptr->dmamac_cntl &= ~DESC_TXCTRL_SIZE1MASK;
 	desc_vptr->dmamac_cntl |= (length << DESC_TXCTRL_SIZE1SHFT) &
 			       DESC_TXCTRL_SIZE1MASK;
 
@@ -438,11 +488,12 @@ static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
 	desc_vptr->txrx_status |= DESC_TXSTS_OWNBYDMA;
 #else
 	/* Reset the descriptor size mask. Not sure what the intention of the old behaviour was... */
-	desc_vptr->dmamac_cntl &= ~DESC_TXCTRL_SIZE1MASK;
+	desc_vptr->dmamac_cntl &= ~(DESC_TXCTRL_SIZE1MASK | DESC_TXCTRL_TXINT);
 
 	desc_vptr->dmamac_cntl |= ((length << DESC_TXCTRL_SIZE1SHFT) & DESC_TXCTRL_SIZE1MASK
 			       ) | DESC_TXCTRL_TXLAST |
-			       DESC_TXCTRL_TXFIRST;
+			       DESC_TXCTRL_TXFIRST |
+			       (irq ? DESC_TXCTRL_TXINT : 0);
 
 	desc_vptr->txrx_status = DESC_TXSTS_OWNBYDMA;
 #endif
@@ -455,6 +506,7 @@ static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
 		desc_num = 0;
 
 	priv->tx_currdescnum = desc_num;
+	priv->tx_inflight++;
 
 	/* Start the transmission */
 	writel(POLL_DATA, &dma_p->txpolldemand);
@@ -462,6 +514,56 @@ static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
 	return 0;
 }
 
+static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
+{
+	u32 desc_num = priv->tx_currdescnum;
+	ulong data_pstart = priv->txbuffs.paddr + desc_num * CONFIG_ETH_BUFSIZE;
+	ulong data_vstart = priv->txbuffs.vaddr + desc_num * CONFIG_ETH_BUFSIZE;
+	ulong data_vend;
+
+	if (length > CONFIG_ETH_BUFSIZE)
+		return -EINVAL;
+
+	if (_dw_tx_full(priv))
+		return -EPERM;
+
+	memcpy((void *)data_vstart, packet, length);
+	if (length < ETH_ZLEN) {
+		memset((void *)(data_vstart + length), 0, ETH_ZLEN - length);
+		length = ETH_ZLEN;
+	}
+
+	/* Flush data to be sent */
+	data_vend = data_vstart + roundup(length, ARCH_DMA_MINALIGN);
+	uboot_flush_dcache_range(data_vstart, data_vend);
+
+	return _dw_eth_xmit(priv, data_pstart, length, NULL, NULL);
+}
+
+/* Send straight from packet, which lives at data_pstart. done(cookie) runs once it is sent */
+static int _dw_eth_send_zerocopy(struct dw_eth_dev *priv, void *packet, ulong data_pstart,
+				 int length, ethif_tx_done_t done, void *cookie)
+{
+	ulong data_vstart = (ulong)packet & ~(ulong)(ARCH_DMA_MINALIGN - 1);
+	ulong data_vend = roundup((ulong)packet + length, ARCH_DMA_MINALIGN);
+
+	/* short frames need padding, which takes a copy */
+	if (length < ETH_ZLEN || length > MAC_MAX_FRAME_SZ ||
+	    data_pstart + length > (1ULL << 32))
+		return -EINVAL;
+
+	if (_dw_tx_full(priv))
+		return -EPERM;
+
+	/*
+	 * The frame may share cache lines with whatever is next to it, which
+	 * is fine as it is only written back, nothing is lost.
+	 */
+	uboot_flush_dcache_range(data_vstart, data_vend);
+
+	return _dw_eth_xmit(priv, data_pstart, length, done, cookie);
+}
+
 static int _dw_eth_recv(struct dw_eth_dev *priv, uchar **packetp)
 {
 	u32 status, desc_num = priv->rx_currdescnum;
@@ -518,6 +620,36 @@ static int _dw_free_pkt(struct dw_eth_dev *priv)
 	return 0;
 }
 
+/*
+ * Lend the current RX buffer out, putting a spare in its place. Returns false
+ * if there is no spare left, the buffer then stays in the ring.
+ */
+static bool _dw_rx_loan(struct dw_eth_dev *priv)
+{
+	struct dmamacdescr *desc_vptr = &((struct dmamacdescr*)priv->rx_mac_descrtable.vaddr)[priv->rx_currdescnum];
+	u32 idx;
+
+	if (priv->rx_nfree == 0)
+		return false;
+
+	idx = priv->rx_free[--priv->rx_nfree];
+	desc_vptr->dmamac_addr = (ulong)priv->rxbuffs.paddr + idx * CONFIG_ETH_BUFSIZE;
+	return true;
+}
+
+/* A buffer lent out by _dw_rx_loan comes back */
+static void _dw_rx_release(struct dw_eth_dev *priv, uchar *packet)
+{
+	ulong offset = (ulong)packet - priv->rxbuffs.vaddr;
+
+	assert(offset < priv->rxbuffs.size && offset % CONFIG_ETH_BUFSIZE == 0);
+	assert(priv->rx_nfree < RX_BUFF_NUM);
+
+	/* Whatever the stack wrote to it must not land on top of the next frame */
+	uboot_flush_dcache_range((ulong)packet, (ulong)packet + CONFIG_ETH_BUFSIZE);
+	priv->rx_free[priv->rx_nfree++] = offset / CONFIG_ETH_BUFSIZE;
+}
+
 static int dw_phy_init(struct dw_eth_dev *priv, void *dev)
 {
 	struct phy_device *phydev;
@@ -572,9 +704,15 @@ static int dw_eth_recv(struct eth_device *dev)
 	length = _dw_eth_recv(dev->priv, &packet);
 	if (length == -EAGAIN)
 		return 0;
-	uboot_process_received_packet(packet, length);
 
-	_dw_free_pkt(dev->priv);
+	if (_dw_rx_loan(dev->priv)) {
+		/* the descriptor has a new buffer, the DMA can have it right away */
+		_dw_free_pkt(dev->priv);
+		uboot_process_received_packet(packet, length, true);
+	} else {
+		uboot_process_received_packet(packet, length, false);
+		_dw_free_pkt(dev->priv);
+	}
 
 	return length;
 }
@@ -591,8 +729,57 @@ static int dw_write_hwaddr(struct eth_device *dev)
 
 int designware_ack(struct eth_device *dev)
 {
-    struct dw_eth_dev *priv = dev->priv;
-    writel(DMA_INTR_DEFAULT_MASK, &priv->dma_regs_p->status);
+	struct dw_eth_dev *priv = dev->priv;
+	struct eth_dma_regs *dma_p = priv->dma_regs_p;
+	u32 status = readl(&dma_p->status);
+
+	writel(DMA_INTR_DEFAULT_MASK, &dma_p->status);
+
+	/* Leave the frames that follow to designware_poll, until it empties the ring */
+	if (status & DMA_INTR_ENA_RIE)
+		writel(readl(&dma_p->intenable) & ~DMA_INTR_ENA_RIE, &dma_p->intenable);
+
+	return 0;
+}
+
+int designware_poll(struct eth_device *dev, int budget)
+{
+	struct dw_eth_dev *priv = dev->priv;
+	struct eth_dma_regs *dma_p = priv->dma_regs_p;
+	int received = 0;
+
+	_dw_tx_reclaim(priv);
+
+	while (received < budget && dw_eth_recv(dev) > 0)
+		received++;
+
+	/* The DMA suspends when it runs out of descriptors, get it going again */
+	if (received > 0)
+		writel(POLL_DATA, &dma_p->rxpolldemand);
+
+	priv->rx_pending = received == budget;
+	if (!priv->rx_pending)
+		writel(readl(&dma_p->intenable) | DMA_INTR_ENA_RIE, &dma_p->intenable);
+
+	return received;
+}
+
+bool designware_rx_pending(struct eth_device *dev)
+{
+	struct dw_eth_dev *priv = dev->priv;
+
+	return priv->rx_pending;
+}
+
+int designware_send_zerocopy(struct eth_device *dev, void *packet, ulong paddr, int length,
+			     ethif_tx_done_t done, void *cookie)
+{
+	return _dw_eth_send_zerocopy(dev->priv, packet, paddr, length, done, cookie);
+}
+
+void designware_release(struct eth_device *dev, uchar *packet)
+{
+	_dw_rx_release(dev->priv, packet);
 }
 
 int designware_read_hwaddr(struct eth_device *dev, u8 *mac_out) {
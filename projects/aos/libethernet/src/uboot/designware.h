@@ -15,11 +15,31 @@
 #include <asm-generic/gpio.h>
 #endif
 
-#define CONFIG_TX_DESCR_NUM	16
-#define CONFIG_RX_DESCR_NUM	16
+/* Ring sizes, set from the build (see CMakeLists.txt) */
+#ifndef CONFIG_TX_DESCR_NUM
+#define CONFIG_TX_DESCR_NUM	64
+#endif
+#ifndef CONFIG_RX_DESCR_NUM
+#define CONFIG_RX_DESCR_NUM	128
+#endif
+/* Spare RX buffers, swapped into the ring in place of ones lent to the stack */
+#ifndef CONFIG_RX_LOAN_NUM
+#define CONFIG_RX_LOAN_NUM	128
+#endif
 #define CONFIG_ETH_BUFSIZE	2048
+#define RX_BUFF_NUM		(CONFIG_RX_DESCR_NUM + CONFIG_RX_LOAN_NUM)
 #define TX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_TX_DESCR_NUM)
-#define RX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_RX_DESCR_NUM)
+#define RX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * RX_BUFF_NUM)
+
+/* Only every this many frames sent raises a TX completion interrupt */
+#ifndef CONFIG_DW_TX_COALESCE
+#define CONFIG_DW_TX_COALESCE	16
+#endif
+/* RX interrupt watchdog, in units of 256 clock cycles after the last frame
+ * received. 0 interrupts on every frame */
+#ifndef CONFIG_DW_RX_RIWT
+#define CONFIG_DW_RX_RIWT	0x40
+#endif
 
 #define CONFIG_MACRESET_TIMEOUT	(3 * CONFIG_SYS_HZ)
 #define CONFIG_MDIO_TIMEOUT	(3 * CONFIG_SYS_HZ)
@@ -75,7 +95,8 @@ struct eth_dma_regs {
 	u32 status;		/* 0x14 */
 	u32 opmode;		/* 0x18 */
 	u32 intenable;		/* 0x1c */
-	u32 reserved1[2];
+	u32 reserved1;
+	u32 riwt;		/* 0x24 */
 	u32 axibus;		/* 0x28 */
 	u32 reserved2[7];
 	u32 currhosttxdesc;	/* 0x48 */
@@ -234,6 +255,17 @@ struct dw_eth_dev {
 	u32 tx_currdescnum;
 	u32 rx_currdescnum;
 
+	u32 tx_dirtydescnum;	/* oldest descriptor not reclaimed yet */
+	u32 tx_inflight;	/* descriptors handed to the DMA */
+	u32 tx_unsignalled;	/* frames sent since the last one to interrupt */
+	ethif_tx_done_t tx_done[CONFIG_TX_DESCR_NUM];
+	void *tx_cookie[CONFIG_TX_DESCR_NUM];
+
+	u32 rx_free[RX_BUFF_NUM];	/* spare RX buffers, as indices into rxbuffs */
+	u32 rx_nfree;
+	bool rx_coalesce;	/* frames only interrupt through the RX watchdog */
+	bool rx_pending;	/* last poll ran out of budget, RX interrupt still masked */
+
 	struct eth_mac_regs *mac_regs_p;
 	struct eth_dma_regs *dma_regs_p;
 #ifndef CONFIG_DM_ETH
@@ -25,7 +25,7 @@
 
 ethif_dma_ops_t *uboot_get_dma_ops();
 
-void uboot_process_received_packet(uint8_t *in_packet, int len);
+void uboot_process_received_packet(uint8_t *in_packet, int len, bool loaned);
 
 extern uint64_t uboot_timestamp_freq;
 
@@ -15,6 +15,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <sel4/sel4.h>
 
 /* System calls for SOS */
@@ -86,6 +87,18 @@ int sos_sys_write(int file, const char *buf, size_t nbyte);
  * Returns -1 on error (invalid file).
  */
 
+long sos_sys_readv(int file, const struct iovec *iov, int iovcnt);
+/* Read from an open file into the "iovcnt" buffers of "iov", in order.
+ * Returns the total number of bytes read, which like sos_sys_read is
+ * short at the end of a console line. Returns -1 on error (invalid file).
+ */
+
+long sos_sys_writev(int file, const struct iovec *iov, int iovcnt);
+/* Write the "iovcnt" buffers of "iov" to an open file, in order.
+ * Returns the total number of bytes written. Returns -1 on error
+ * (invalid file).
+ */
+
 int sos_getdirent(int pos, char *name, size_t nbyte);
 /* Reads name of entry "pos" in directory into "name", max "nbyte" bytes.
  * Returns number of bytes returned, zero if "pos" is next free entry,
@@ -125,6 +138,16 @@ int64_t sos_sys_time_stamp(void);
 /* Returns time in microseconds since booting.
  */
 
+/* The timer's register page is mapped read-only at SOS_TIMER_PAGE_VADDR in
+ * every process. Timer E in it counts microseconds, see clock/device.h.
+ */
+#define SOS_TIMER_PAGE_VADDR  (0xA000000000)
+
+int64_t sos_time_now(void);
+/* Same clock as sos_sys_time_stamp, read straight off the timer page
+ * without entering SOS.
+ */
+
 void sos_sys_usleep(int msec);
 /* Sleeps for the specified number of milliseconds.
  */
@@ -133,14 +156,95 @@ long sos_sys_brk(uintptr_t newbrk);
 /* Trivial
  */
 
-long sos_sys_mmap(uintptr_t vaddr, size_t len, int prot);
-/* Trivial
+long sos_sys_mmap(uintptr_t vaddr, size_t len, int prot, int flags);
+/* Maps len bytes at vaddr, or wherever there is room if vaddr is 0.
+ * With MAP_POPULATE in flags the pages are faulted in right away.
  */
 
 long sos_sys_munmap(uintptr_t vaddr, size_t len);
 /* Trivial
  */
 
+long sos_sys_madvise(uintptr_t vaddr, size_t len, int advice);
+/* MADV_WILLNEED pages back in whatever was paged out of the range,
+ * MADV_DONTNEED frees its frames and pagefile slots right away. It only
+ * applies to memory from sos_sys_mmap (-EINVAL otherwise) and leaves pages
+ * SOS is in the middle of using alone.
+ * Returns 0 on success, -errno otherwise.
+ */
+
+
+/* Asynchronous syscall ring
+ *
+ * A single page shared with SOS, holding a submission queue (SQ) filled by
+ * the process and a completion queue (CQ) filled by SOS. Each side only
+ * ever moves its own indices: the process owns sq_tail and cq_head, SOS
+ * owns sq_head and cq_tail. Indices run freely and wrap modulo
+ * SOS_RING_ENTRIES.
+ */
+
+#define SOS_RING_VADDR   (0xA000001000)
+#define SOS_RING_ENTRIES 64
+
+/* ring operations, sos_sqe_t.op */
+#define SOS_OP_NOP    0
+#define SOS_OP_OPEN   1    /* addr = path, len = strlen(path), arg = mode */
+#define SOS_OP_READ   2    /* fd, addr = buf, len = nbyte */
+#define SOS_OP_WRITE  3    /* fd, addr = buf, len = nbyte */
+#define SOS_OP_CLOSE  4    /* fd */
+#define SOS_OP_USLEEP 5    /* arg = msec */
+#define SOS_OP_READV  6    /* fd, addr = iov, len = iovcnt */
+#define SOS_OP_WRITEV 7    /* fd, addr = iov, len = iovcnt */
+
+typedef struct {
+    uint32_t op;
+    int32_t  fd;
+    uint64_t addr;
+    uint64_t len;
+    uint64_t arg;
+    uint64_t user_data;    /* handed back untouched in the completion */
+} sos_sqe_t;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t  res;          /* what the equivalent sos_sys_* call returns */
+} sos_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    sos_sqe_t sq[SOS_RING_ENTRIES];
+    sos_cqe_t cq[SOS_RING_ENTRIES];
+} sos_ring_t;
+
+int sos_ring_setup(void);
+/* Map the syscall ring at SOS_RING_VADDR. Returns 0 if successful, -1
+ * otherwise. Calling it again is a no-op.
+ */
+
+sos_sqe_t *sos_ring_get_sqe(void);
+/* Returns the next free submission entry for the caller to fill in, or
+ * NULL if SOS_RING_ENTRIES operations are already queued or in flight.
+ * Nothing is seen by SOS until sos_ring_submit.
+ */
+
+int sos_ring_submit(void);
+/* Hand every entry taken with sos_ring_get_sqe to SOS with a single
+ * notification, without waiting for any of them. Returns the number of
+ * entries submitted.
+ */
+
+int sos_ring_peek_cqe(sos_cqe_t *cqe);
+/* Reap one completion into "cqe" without blocking. Returns 0 if one was
+ * available, -1 otherwise.
+ */
+
+int sos_ring_wait_cqe(sos_cqe_t *cqe);
+/* Reap one completion into "cqe", blocking until one is posted. Returns 0
+ * if successful, -1 if nothing is in flight.
+ */
 
 /*************************************************************************/
 /*                                   */
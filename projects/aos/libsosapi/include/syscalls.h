@@ -34,6 +34,7 @@ long sys_ioctl(va_list ap);
 long sys_brk(va_list ap);
 long sys_mmap(va_list ap);
 long sys_munmap(va_list ap);
+long sys_madvise(va_list ap);
 long sys_writev(va_list ap);
 long sys_write(va_list ap);
 long sys_nanosleep(va_list ap);
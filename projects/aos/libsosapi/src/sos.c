@@ -16,9 +16,9 @@
 #include <sos.h>
 
 #include <sel4/sel4.h>
+#include <clock/device.h>
 
 #define SYSCALL_ENDPOINT_SLOT          (1)
-#define SHARED_BUFFER_VADDR            (0xA000001000)
 #define PAGE_SIZE_4K                   (0x1000)
 
 #define SYSCALL_NO_OPEN           (0)
@@ -37,9 +37,43 @@
 #define SYSCALL_NO_PROCESS_WAIT   (13)
 #define SYSCALL_NO_MMAP           (14)
 #define SYSCALL_NO_MUNMAP         (15)
+#define SYSCALL_NO_RING_SETUP     (18)
+#define SYSCALL_NO_RING_ENTER     (19)
+#define SYSCALL_NO_READV          (20)
+#define SYSCALL_NO_WRITEV         (21)
+#define SYSCALL_NO_MADVISE        (22)
 
 #define SYSCALL_NO_UNIMPL     (100)
 
+/* Paths up to this long are sent inline in the message registers instead
+ * of having SOS copy them in from our address space */
+#define INLINE_PATH_MAX           (256)
+
+#define MR_WORDS(bytes) (((bytes) + sizeof(seL4_Word) - 1) / sizeof(seL4_Word))
+
+/* Pack len bytes of data into the message registers from mr onwards.
+ * Returns the resulting message length. */
+static seL4_Word set_payload(seL4_Word mr, const void *data, size_t len)
+{
+    memcpy(&seL4_GetIPCBuffer()->msg[mr], data, len);
+    return mr + MR_WORDS(len);
+}
+
+/* Set a path argument: pointer at mr and length at mr + 1, where a NULL
+ * pointer tells SOS the path is packed inline from payload_mr onwards.
+ * Returns the resulting message length. */
+static seL4_Word set_path(seL4_Word mr, seL4_Word payload_mr, const char *path)
+{
+    size_t len = strlen(path);
+    seL4_SetMR(mr + 1, len);
+    if (len > INLINE_PATH_MAX) {
+        seL4_SetMR(mr, (seL4_Word) path);
+        return payload_mr;
+    }
+    seL4_SetMR(mr, 0);
+    return set_payload(payload_mr, path, len);
+}
+
 static int unimplemented_syscall() {
     printf("Calling unimplemented syscall, using placeholder id %d\n", SYSCALL_NO_UNIMPL);
     seL4_SetMR(0, SYSCALL_NO_UNIMPL);
@@ -50,11 +84,9 @@ static int unimplemented_syscall() {
 int sos_sys_open(const char *path, fmode_t mode)
 {
     seL4_SetMR(0, SYSCALL_NO_OPEN);
-    seL4_SetMR(1, (seL4_Word) path);
-    seL4_SetMR(2, strlen(path));
     seL4_SetMR(3, mode);
-    // seL4_SetMR(3, 0);
-    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
+    seL4_Word length = set_path(1, 4, path);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, length));
     return seL4_GetMR(0);
 }
 
@@ -86,6 +118,26 @@ int sos_sys_write(int file, const char *buf, size_t nbyte)
     return seL4_GetMR(0);
 }
 
+long sos_sys_readv(int file, const struct iovec *iov, int iovcnt)
+{
+    seL4_SetMR(0, SYSCALL_NO_READV);
+    seL4_SetMR(1, file);
+    seL4_SetMR(2, (seL4_Word) iov);
+    seL4_SetMR(3, iovcnt);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
+    return seL4_GetMR(0);
+}
+
+long sos_sys_writev(int file, const struct iovec *iov, int iovcnt)
+{
+    seL4_SetMR(0, SYSCALL_NO_WRITEV);
+    seL4_SetMR(1, file);
+    seL4_SetMR(2, (seL4_Word) iov);
+    seL4_SetMR(3, iovcnt);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
+    return seL4_GetMR(0);
+}
+
 int sos_getdirent(int pos, char *name, size_t nbyte)
 {
     seL4_SetMR(0, SYSCALL_NO_GETDIRENT);
@@ -99,19 +151,23 @@ int sos_getdirent(int pos, char *name, size_t nbyte)
 int sos_stat(const char *path, sos_stat_t *buf)
 {
     seL4_SetMR(0, SYSCALL_NO_STAT);
-    seL4_SetMR(1, (seL4_Word) path);
-    seL4_SetMR(2, strlen(path));
-    seL4_SetMR(3, buf);
-    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
-    return seL4_GetMR(0);
+    /* ask for the result inline rather than copied out to buf */
+    seL4_SetMR(3, 0);
+    seL4_Word length = set_path(1, 4, path);
+    seL4_MessageInfo_t reply = seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, length));
+    int ret = seL4_GetMR(0);
+    if (ret == 0) {
+        if (seL4_MessageInfo_get_length(reply) < 1 + MR_WORDS(sizeof(sos_stat_t))) return -1;
+        memcpy(buf, &seL4_GetIPCBuffer()->msg[1], sizeof(sos_stat_t));
+    }
+    return ret;
 }
 
 pid_t sos_process_create(const char *path)
 {
     seL4_SetMR(0, SYSCALL_NO_PROCESS_CREATE);
-    seL4_SetMR(1, (seL4_Word) path);
-    seL4_SetMR(2, strlen(path));
-    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 3));
+    seL4_Word length = set_path(1, 3, path);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, length));
     return seL4_GetMR(0);
 }
 
@@ -161,6 +217,11 @@ int64_t sos_sys_time_stamp(void)
     return seL4_GetMR(0);
 }
 
+int64_t sos_time_now(void)
+{
+    return meson_timestamp((void *) SOS_TIMER_PAGE_VADDR);
+}
+
 long sos_sys_brk(uintptr_t newbrk) {
     seL4_SetMR(0, SYSCALL_NO_BRK);
     seL4_SetMR(1, newbrk);
@@ -168,12 +229,13 @@ long sos_sys_brk(uintptr_t newbrk) {
     return seL4_GetMR(0);
 }
 
-long sos_sys_mmap(uintptr_t vaddr, size_t len, int prot) {
+long sos_sys_mmap(uintptr_t vaddr, size_t len, int prot, int flags) {
     seL4_SetMR(0, SYSCALL_NO_MMAP);
     seL4_SetMR(1, vaddr);
     seL4_SetMR(2, len);
     seL4_SetMR(3, prot);
-    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
+    seL4_SetMR(4, flags);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 5));
     long res = seL4_GetMR(0);
     return res;
 }
@@ -185,3 +247,83 @@ long sos_sys_munmap(uintptr_t vaddr, size_t len) {
     seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 3));
     return seL4_GetMR(0);
 }
+
+long sos_sys_madvise(uintptr_t vaddr, size_t len, int advice) {
+    seL4_SetMR(0, SYSCALL_NO_MADVISE);
+    seL4_SetMR(1, vaddr);
+    seL4_SetMR(2, len);
+    seL4_SetMR(3, advice);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 4));
+    return seL4_GetMR(0);
+}
+
+static sos_ring_t *ring;
+/* notification cap SOS watches for new submissions */
+static seL4_CPtr ring_doorbell;
+/* entries handed out by sos_ring_get_sqe, published by sos_ring_submit */
+static uint32_t sq_local_tail;
+/* entries taken and not reaped yet, never more than the CQ can hold */
+static unsigned ring_outstanding;
+
+int sos_ring_setup(void)
+{
+    if (ring != NULL) return 0;
+    seL4_SetMR(0, SYSCALL_NO_RING_SETUP);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 1));
+    if ((long) seL4_GetMR(0) <= 0) return -1;
+    ring_doorbell = seL4_GetMR(0);
+    ring = (sos_ring_t *) SOS_RING_VADDR;
+    sq_local_tail = ring->sq_tail;
+    return 0;
+}
+
+sos_sqe_t *sos_ring_get_sqe(void)
+{
+    if (ring == NULL || ring_outstanding == SOS_RING_ENTRIES) return NULL;
+    sos_sqe_t *sqe = &ring->sq[sq_local_tail % SOS_RING_ENTRIES];
+    sq_local_tail++;
+    ring_outstanding++;
+    memset(sqe, 0, sizeof(sos_sqe_t));
+    return sqe;
+}
+
+static void ring_enter(int wait)
+{
+    __atomic_store_n(&ring->sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    if (wait) {
+        seL4_SetMR(0, SYSCALL_NO_RING_ENTER);
+        seL4_SetMR(1, wait);
+        seL4_Call(SYSCALL_ENDPOINT_SLOT, seL4_MessageInfo_new(0, 0, 0, 2));
+    } else {
+        seL4_Signal(ring_doorbell);
+    }
+}
+
+int sos_ring_submit(void)
+{
+    if (ring == NULL) return 0;
+    int n = sq_local_tail - ring->sq_tail;
+    if (n > 0) ring_enter(0);
+    return n;
+}
+
+int sos_ring_peek_cqe(sos_cqe_t *cqe)
+{
+    if (ring == NULL) return -1;
+    uint32_t head = ring->cq_head;
+    if (head == __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE)) return -1;
+    *cqe = ring->cq[head % SOS_RING_ENTRIES];
+    __atomic_store_n(&ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    ring_outstanding--;
+    return 0;
+}
+
+int sos_ring_wait_cqe(sos_cqe_t *cqe)
+{
+    while (sos_ring_peek_cqe(cqe)) {
+        if (ring == NULL || ring_outstanding == 0) return -1;
+        /* also publishes anything taken but not submitted yet */
+        ring_enter(1);
+    }
+    return 0;
+}
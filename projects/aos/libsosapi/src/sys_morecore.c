@@ -39,7 +39,7 @@ long sys_mmap(va_list ap)
     int fd = va_arg(ap, int);
     off_t offset = va_arg(ap, off_t);
 
-    return sos_sys_mmap((uintptr_t) addr, length, prot);
+    return sos_sys_mmap((uintptr_t) addr, length, prot, flags);
 }
 
 long sys_munmap(va_list ap)
@@ -48,3 +48,11 @@ long sys_munmap(va_list ap)
     size_t length = va_arg(ap, size_t);
     return sos_sys_munmap((uintptr_t) addr, length);
 }
+
+long sys_madvise(va_list ap)
+{
+    void *addr = va_arg(ap, void *);
+    size_t length = va_arg(ap, size_t);
+    int advice = va_arg(ap, int);
+    return sos_sys_madvise((uintptr_t) addr, length, advice);
+}
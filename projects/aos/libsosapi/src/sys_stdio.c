@@ -41,7 +41,6 @@ long sys_writev(va_list ap)
     int iovcnt = va_arg(ap, int);
 
     long long sum = 0;
-    long ret = 0;
 
     /* The iovcnt argument is valid if greater than 0 and less than or equal to IOV_MAX. */
     if (iovcnt <= 0 || iovcnt > IOV_MAX) {
@@ -62,29 +61,7 @@ long sys_writev(va_list ap)
         return 0;
     }
 
-    /* Write the buffer to console if the fd is for stdout or stderr. */
-    /*if (fildes == STDOUT_FD || fildes == STDERR_FD) {
-        for (int i = 0; i < iovcnt; i++) {
-            size_t nr = sos_write(iov[i].iov_base, iov[i].iov_len);
-
-            ret += nr;
-            if (nr != iov[i].iov_len) break;
-        }
-    } else */ {
-        for (int i = 0; i < iovcnt; i++) {
-            int nr = sos_sys_write(fildes, iov[i].iov_base, iov[i].iov_len);
-
-            if (nr < 0) {
-                if (!ret) ret = nr;
-                break;
-            }
-
-            ret += nr;
-            if (nr != iov[i].iov_len) break;
-        }
-    }
-
-    return ret;
+    return sos_sys_writev(fildes, iov, iovcnt);
 }
 
 long sys_readv(va_list ap)
@@ -92,22 +69,12 @@ long sys_readv(va_list ap)
     int fd = va_arg(ap, int);
     struct iovec *iov = va_arg(ap, struct iovec *);
     int iovcnt = va_arg(ap, int);
-    int i;
-    long ret = 0;
-
-    for (i = 0; i < iovcnt; i++) {
-        int nr = sos_sys_read(fd, iov[i].iov_base, iov[i].iov_len);
-
-        if (nr < 0) {
-            if (!ret) ret = nr;
-            break;
-        }
 
-        ret += nr;
-        if (nr != iov[i].iov_len) break;
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
     }
 
-    return ret;
+    return sos_sys_readv(fd, iov, iovcnt);
 }
 
 long sys_read(va_list ap)
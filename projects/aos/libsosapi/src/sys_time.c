@@ -42,7 +42,7 @@ long sys_clock_gettime(va_list ap)
     if (clk_id != CLOCK_REALTIME) {
         return -EINVAL;
     }
-    int64_t micros = sos_sys_time_stamp();
+    int64_t micros = sos_time_now();
     res->tv_sec = micros / US_IN_S;
     res->tv_nsec = (micros % US_IN_S) * NS_IN_US;
     return 0;
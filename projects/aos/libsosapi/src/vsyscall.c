@@ -30,6 +30,7 @@ void sosapi_init_syscall_table(void)
     muslcsys_install_syscall(__NR_brk, sys_brk);
     muslcsys_install_syscall(__NR_mmap, sys_mmap);
     muslcsys_install_syscall(__NR_munmap, sys_munmap);
+    muslcsys_install_syscall(__NR_madvise, sys_madvise);
     muslcsys_install_syscall(__NR_writev, sys_writev);
     muslcsys_install_syscall(__NR_write, sys_write);
     muslcsys_install_syscall(__NR_nanosleep, sys_nanosleep);
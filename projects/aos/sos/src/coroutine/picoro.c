@@ -1,161 +1,328 @@
 /*
  * picoro - minimal coroutines for C.
- * Written by Tony Finch <dot@dotat.at>
+ * Originally written by Tony Finch <dot@dotat.at>
  * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * Reworked for SOS: stacks are frame table pages mapped into their own
+ * guard-paged slot, and context switches are a hand-written AArch64
+ * register save/restore instead of recursive setjmp/longjmp.
  */
 
-#pragma GCC push_options
-#pragma GCC optimize ("O0")
-
 #include <assert.h>
-#include <setjmp.h>
 #include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
 
 #include "picoro.h"
+#include "../mapping.h"
+#include "../vmem_layout.h"
+#include "../vm/frame_table.h"
 
 /*
- * Each coroutine has a jmp_buf to hold its context when suspended.
- *
- * There are lists of running and idle coroutines.
+ * Every coroutine owns a fixed slot of CORO_SLOT_PAGES pages starting at
+ * SOS_CORO_STACKS. The lowest page of a slot is never mapped, so running off
+ * the end of a stack faults instead of silently corrupting a neighbour.
  *
- * The coroutine at the head of the running list has the CPU, and all
- * others are suspended inside resume(). The "first" coro object holds
- * the context for the program's initial stack and also ensures that
- * all externally-visible list elements have non-NULL next pointers.
- * (The "first" coroutine isn't exposed to the caller.)
- *
- * The idle list contains coroutines that are suspended in
- * coroutine_main(). After initialization it is never NULL except
- * briefly while coroutine_main() forks a new idle coroutine.
+ * SOS is the root task and has no fault handler of its own, so a stack
+ * cannot be grown on demand: touching the guard page stops SOS. Every stack
+ * is therefore fully mapped when the coroutine is created. CORO_STACK_PAGES
+ * is the 16 KiB the original fixed stacks had, which the deepest SOS paths
+ * (a PATH_MAX name on the stack under open/exec, then the VFS and libnfs)
+ * have always run in. Keep it that small, as every blocked syscall and
+ * fault pins one.
  */
-static struct coro {
-	struct coro *next;
-	jmp_buf state;
-} first, *running = &first, *idle;
+#define CORO_STACK_PAGES        4
+#define CORO_SLOT_PAGES         (CORO_STACK_PAGES + 1)
+#define CORO_SLOT_SIZE          (CORO_SLOT_PAGES * PAGE_SIZE_4K)
 
 /*
- * A coroutine can be passed to resume() if
- * it is not on the running or idle lists.
+ * Finished coroutines keep their stacks for reuse, up to CORO_POOL_MAX of
+ * them. Beyond that their pages go back to the frame table and only the
+ * descriptor (and its virtual slot) is kept around.
  */
-int resumable(coro_t c) {
-	return(c != NULL && c->next == NULL);
-}
+#define CORO_POOL_MAX           64
 
 /*
- * Add a coroutine to a list and return the previous head of the list.
+ * Callee-saved register state. The layout is shared with coro_switch below,
+ * so keep the two in sync.
  */
-static void push(coro_t *list, coro_t c) {
-	c->next = *list;
-	*list = c;
-}
+struct coro_ctx {
+    seL4_Word x19_x28[10];
+    seL4_Word fp;
+    seL4_Word lr;
+    seL4_Word sp;
+    seL4_Word d8_d15[8];
+};
+compile_time_assert("coro_ctx layout", sizeof(struct coro_ctx) == 168);
+
+enum coro_state {
+    CORO_IDLE,
+    CORO_SUSPENDED,
+    CORO_RUNNING,
+    CORO_DONE,
+};
+
+/*
+ * The running coroutines form a stack through "next": the head has the CPU
+ * and every other entry is blocked in resume() waiting for the one above it.
+ * Idle coroutines are chained through "next" on the hot (stack still mapped)
+ * or cold (stack released) pool. The "first" coroutine is the initial SOS
+ * stack and is never exposed to the caller.
+ */
+struct coro {
+    struct coro *next;
+    struct coro_ctx ctx;
+    enum coro_state state;
+    /* scheduling class, only interpreted by sched.c */
+    int prio;
+    /* owned by the run queue, see set_coro_queued */
+    int queued;
+    void *(*fun)(void *arg);
+    /* top of this coroutine's stack slot */
+    uintptr_t stack_top;
+    /* number of pages mapped down from stack_top */
+    size_t npages;
+    frame_ref_t frames[CORO_STACK_PAGES];
+    seL4_CPtr caps[CORO_STACK_PAGES];
+};
+
+static struct coro first = { .state = CORO_RUNNING };
+static coro_t running = &first;
+static coro_t hot_pool, cold_pool;
+static size_t hot_count;
+static size_t nslots;
+
+/* value handed across the current switch */
+static void *transfer;
+
+void coro_switch(struct coro_ctx *from, struct coro_ctx *to);
+
+/* d8-d15 are only live when SOS is built with the FPU enabled */
+#ifdef __ARM_FP
+#define CORO_SAVE_FP \
+    "    stp d8, d9, [x0, #104]\n" \
+    "    stp d10, d11, [x0, #120]\n" \
+    "    stp d12, d13, [x0, #136]\n" \
+    "    stp d14, d15, [x0, #152]\n"
+#define CORO_LOAD_FP \
+    "    ldp d8, d9, [x1, #104]\n" \
+    "    ldp d10, d11, [x1, #120]\n" \
+    "    ldp d12, d13, [x1, #136]\n" \
+    "    ldp d14, d15, [x1, #152]\n"
+#else
+#define CORO_SAVE_FP
+#define CORO_LOAD_FP
+#endif
+
+/*
+ * Save the callee-saved registers of the caller into "from" and load the
+ * ones in "to". Returning then lands wherever "to" last called coro_switch,
+ * or at the entry point planted by coro_reset.
+ */
+asm(
+    ".text\n"
+    ".global coro_switch\n"
+    ".type coro_switch, %function\n"
+    "coro_switch:\n"
+    "    stp x19, x20, [x0, #0]\n"
+    "    stp x21, x22, [x0, #16]\n"
+    "    stp x23, x24, [x0, #32]\n"
+    "    stp x25, x26, [x0, #48]\n"
+    "    stp x27, x28, [x0, #64]\n"
+    "    stp x29, x30, [x0, #80]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0, #96]\n"
+    CORO_SAVE_FP
+    "    ldp x19, x20, [x1, #0]\n"
+    "    ldp x21, x22, [x1, #16]\n"
+    "    ldp x23, x24, [x1, #32]\n"
+    "    ldp x25, x26, [x1, #48]\n"
+    "    ldp x27, x28, [x1, #64]\n"
+    "    ldp x29, x30, [x1, #80]\n"
+    "    ldr x9, [x1, #96]\n"
+    "    mov sp, x9\n"
+    CORO_LOAD_FP
+    "    ret\n"
+    ".size coro_switch, . - coro_switch\n"
+);
 
 /*
- * Remove a coroutine from a list and return it.
+ * A coroutine can be passed to resume() if it has been created
+ * and is neither running, blocked in resume(), finished nor waiting on
+ * the run queue.
  */
-static coro_t pop(coro_t *list) {
-	coro_t c = *list;
-	*list = c->next;
-	c->next = NULL;
-	return(c);
+int resumable(coro_t c) {
+    return c != NULL && c->state == CORO_SUSPENDED && !c->queued;
+}
+
+/* Map one more page below the current bottom of c's stack. */
+static int stack_grow(coro_t c) {
+    if (c->npages == CORO_STACK_PAGES) return -1;
+
+    frame_ref_t frame = alloc_sos_frame();
+    if (frame == NULL_FRAME) return -1;
+
+    cspace_t *cspace = frame_table_cspace();
+    seL4_CPtr cap = cspace_alloc_slot(cspace);
+    if (cap == seL4_CapNull) {
+        unpin_frame(frame);
+        free_frame(frame);
+        return -1;
+    }
+
+    int err = cspace_copy(cspace, cap, cspace, frame_page(frame), seL4_AllRights);
+    if (err == seL4_NoError) {
+        uintptr_t vaddr = c->stack_top - (c->npages + 1) * PAGE_SIZE_4K;
+        err = map_frame(cspace, cap, seL4_CapInitThreadVSpace, vaddr, seL4_ReadWrite,
+                        seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever);
+        if (err != seL4_NoError) cspace_delete(cspace, cap);
+    }
+    if (err != seL4_NoError) {
+        ZF_LOGE("Failed to map coroutine stack page");
+        cspace_free_slot(cspace, cap);
+        unpin_frame(frame);
+        free_frame(frame);
+        return -1;
+    }
+
+    c->frames[c->npages] = frame;
+    c->caps[c->npages] = cap;
+    c->npages++;
+    return 0;
+}
+
+/* Give every stack page of an idle coroutine back to the frame table. */
+static void stack_release(coro_t c) {
+    cspace_t *cspace = frame_table_cspace();
+    while (c->npages > 0) {
+        c->npages--;
+        seL4_ARM_Page_Unmap(c->caps[c->npages]);
+        cspace_delete(cspace, c->caps[c->npages]);
+        cspace_free_slot(cspace, c->caps[c->npages]);
+        unpin_frame(c->frames[c->npages]);
+        free_frame(c->frames[c->npages]);
+    }
+}
+
+static void coro_boot(void) NORETURN;
+
+/* Point c's saved context at a fresh activation of coro_boot. */
+static void coro_reset(coro_t c) {
+    memset(&c->ctx, 0, sizeof(c->ctx));
+    c->ctx.sp = c->stack_top;
+    c->ctx.lr = (seL4_Word) coro_boot;
 }
 
 /*
- * Pass a value and control from one coroutine to another.
- * The current coroutine's state is saved in "me" and the
- * target coroutine is at the head of the "running" list.
+ * Entry point of every activation. Runs the function it was created for,
+ * then parks as CORO_DONE and hands the result to its resumer, which
+ * recycles it. We never come back here after that.
  */
-static void *pass(coro_t me, void *arg) {
-	static void *saved;
-	saved = arg;
-	if(!setjmp(me->state))
-		longjmp(running->state, 1);
-	return(saved);
+static void coro_boot(void) {
+    coro_t me = running;
+    void *ret = me->fun(transfer);
+
+    me->fun = NULL;
+    me->state = CORO_DONE;
+    running = me->next;
+    me->next = NULL;
+    transfer = ret;
+    coro_switch(&me->ctx, &running->ctx);
+    UNREACHABLE();
+}
+
+/* Return a finished coroutine to the pool. Called on the resumer's stack. */
+static void coro_retire(coro_t c) {
+    c->state = CORO_IDLE;
+    if (hot_count < CORO_POOL_MAX) {
+        c->next = hot_pool;
+        hot_pool = c;
+        hot_count++;
+    } else {
+        stack_release(c);
+        c->next = cold_pool;
+        cold_pool = c;
+    }
 }
 
 void *resume(coro_t c, void *arg) {
-	assert(resumable(c));
-	push(&running, c);
-	return(pass(c->next, arg));
+    assert(resumable(c));
+    c->state = CORO_RUNNING;
+    c->next = running;
+    running = c;
+    transfer = arg;
+    coro_switch(&c->next->ctx, &c->ctx);
+    /* c has yielded or finished back to us */
+    if (c->state == CORO_DONE) coro_retire(c);
+    return transfer;
 }
 
 void *yield(void *arg) {
-	return(pass(pop(&running), arg));
+    coro_t me = running;
+    assert(me != &first);
+    running = me->next;
+    me->next = NULL;
+    me->state = CORO_SUSPENDED;
+    transfer = arg;
+    coro_switch(&me->ctx, &running->ctx);
+    return transfer;
 }
 
-/* Declare for mutual recursion. */
-void coroutine_start(void), coroutine_main(void*);
-
 /*
  * The coroutine constructor function.
  *
- * On the first invocation there are no idle coroutines, so fork the
- * first one, which will immediately yield back to us after becoming
- * idle. When there are idle coroutines, we pass one the function
- * pointer and return the activated coroutine's address.
+ * Reuse a pooled coroutine if there is one (preferring one that still has
+ * its stack), otherwise carve a new slot. Returns NULL if no stack could be
+ * allocated.
  */
 coro_t coroutine(void *fun(void *arg)) {
-	if(idle == NULL && !setjmp(running->state))
-		coroutine_start();
-	return(resume(pop(&idle), fun));
+    coro_t c;
+    if (hot_pool != NULL) {
+        c = hot_pool;
+        hot_pool = c->next;
+        hot_count--;
+    } else if (cold_pool != NULL) {
+        c = cold_pool;
+        cold_pool = c->next;
+    } else {
+        c = calloc(1, sizeof(*c));
+        if (c == NULL) return NULL;
+        /* slot base is the guard page, the stack grows down from the slot end */
+        c->stack_top = SOS_CORO_STACKS + (nslots + 1) * CORO_SLOT_SIZE;
+        nslots++;
+        c->state = CORO_IDLE;
+    }
+
+    while (c->npages < CORO_STACK_PAGES) {
+        if (stack_grow(c)) {
+            stack_release(c);
+            c->next = cold_pool;
+            cold_pool = c;
+            return NULL;
+        }
+    }
+
+    c->next = NULL;
+    c->fun = fun;
+    c->prio = 0;
+    c->queued = 0;
+    coro_reset(c);
+    c->state = CORO_SUSPENDED;
+    return c;
 }
 
-/*
- * The main loop for a coroutine is responsible for managing the "idle" list.
- *
- * When we start the idle list is empty, so we put ourself on it to
- * ensure it remains non-NULL. Then we immediately suspend ourself
- * waiting for the first function we are to run. (The head of the
- * running list is the coroutine that forked us.) We pass the stack
- * pointer to prevent it from being optimised away. The first time we
- * are called we will return to the fork in the coroutine()
- * constructor function (above); on subsequent calls we will resume
- * the parent coroutine_main(). In both cases the passed value is
- * lost when pass() longjmp()s to the forking setjmp().
- *
- * When we are resumed, the idle list is empty again, so we fork
- * another coroutine. When the child coroutine_main() passes control
- * back to us, we drop into our main loop.
- *
- * We are now head of the running list with a function to call. We
- * immediately yield a pointer to our context object so our creator
- * can identify us. The creator can then resume us at which point we
- * pass the argument to the function to start executing.
- *
- * When the function returns, we move ourself from the running list to
- * the idle list, before passing the result back to the resumer. (This
- * is just like yield() except for adding the coroutine to the idle
- * list.) We can then only be resumed by the coroutine() constructor
- * function which will put us back on the running list and pass us a
- * new function to call.
- *
- * We do not declare coroutine_main() static to try to stop it being inlined.
- *
- * The conversion between the function pointer and a void pointer is not
- * allowed by ANSI C but we do it anyway.
- */
-void coroutine_main(void *ret) {
-	void *(*fun)(void *arg);
-	struct coro me;
-	push(&idle, &me);
-	fun = pass(&me, ret);
-	if(!setjmp(running->state))
-		coroutine_start();
-	for(;;) {
-		ret = fun(yield(&me));
-		push(&idle, pop(&running));
-		fun = pass(&me, ret);
-	}
+void set_coro_queued(coro_t c, int queued) {
+    assert(c->state == CORO_SUSPENDED || c == running);
+    assert(c->queued != queued);
+    c->queued = queued;
 }
 
-/*
- * Allocate space for the current stack to grow before creating the
- * initial stack frame for the next coroutine.
- */
-void coroutine_start(void) {
-	char stack[16 * 1024];
-	coroutine_main(stack);
+int coro_prio(coro_t c) {
+    return c->prio;
 }
 
-#pragma GCC pop_options
+void set_coro_prio(coro_t c, int prio) {
+    c->prio = prio;
+}
 
 /* eof */
@@ -16,7 +16,9 @@ typedef struct coro *coro_t;
  * When it is first resumed, the argument to resume() is passed to fun().
  * If fun() returns, its return value is returned by resume() as if the
  * coroutine yielded, except that the coroutine is then no longer resumable
- * and may be discarded.
+ * and is recycled for a later coroutine() call.
+ * Every coroutine gets a fixed 16 KiB stack; going deeper than that stops SOS.
+ * Returns NULL if no stack could be allocated for the coroutine.
  */
 coro_t coroutine(void *fun(void *arg));
 
@@ -40,4 +42,15 @@ void *resume(coro_t c, void *arg);
  */
 void *yield(void *arg);
 
+/*
+ * Scheduling class of a coroutine, see sched.h. New coroutines start at 0.
+ */
+int coro_prio(coro_t c);
+/*
+ * Hand a coroutine to the run queue (or take it back). It must be suspended
+ * or about to yield. While queued it is not resumable by anyone else.
+ */
+void set_coro_queued(coro_t c, int queued);
+void set_coro_prio(coro_t c, int prio);
+
 #endif /* PICORO_H */
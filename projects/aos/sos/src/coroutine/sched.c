@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <utils/util.h>
+
+#include "sched.h"
+
+/*
+ * One FIFO per scheduling class. Entries are recycled through a free list
+ * so waking a coroutine normally does not hit malloc.
+ */
+typedef struct sched_entry {
+    coro_t coro;
+    void *arg;
+    /* value of sched_round when the entry was queued */
+    unsigned long round;
+    struct sched_entry *next;
+} sched_entry_t;
+
+static struct {
+    sched_entry_t *head;
+    sched_entry_t *tail;
+} runq[SCHED_NCLASSES];
+
+static sched_entry_t *free_entries;
+static size_t queued;
+static unsigned long sched_round;
+static unsigned int yield_ticks;
+
+/* classes in the order they are served */
+static const sched_class_t class_order[SCHED_NCLASSES] = {
+    SCHED_FAULT, SCHED_SYSCALL, SCHED_BACKGROUND,
+};
+
+static int sched_enqueue(coro_t coro, void *arg) {
+    sched_entry_t *e = free_entries;
+    if (e != NULL) {
+        free_entries = e->next;
+    } else {
+        e = malloc(sizeof(sched_entry_t));
+        if (e == NULL) return -1;
+    }
+
+    int class = coro_prio(coro);
+    assert(class >= 0 && class < SCHED_NCLASSES);
+    e->coro = coro;
+    e->arg = arg;
+    e->round = sched_round;
+    e->next = NULL;
+    set_coro_queued(coro, 1);
+    if (runq[class].tail) {
+        runq[class].tail->next = e;
+    } else {
+        runq[class].head = e;
+    }
+    runq[class].tail = e;
+    queued++;
+    return 0;
+}
+
+void sched_wake(coro_t coro, void *arg) {
+    assert(resumable(coro));
+    if (sched_enqueue(coro, arg)) {
+        ZF_LOGE("Run queue full, resuming %p directly", coro);
+        resume(coro, arg);
+    }
+}
+
+void sched_yield_point(coro_t coro) {
+    if (coro == NULL || ++yield_ticks < SCHED_YIELD_INTERVAL) return;
+    yield_ticks = 0;
+    if (sched_enqueue(coro, NULL) == 0) yield(NULL);
+}
+
+void sched_yield(coro_t coro) {
+    assert(coro != NULL);
+    if (sched_enqueue(coro, NULL)) {
+        ZF_LOGE("Run queue full, cannot yield");
+        return;
+    }
+    yield(NULL);
+}
+
+/* Pop the first entry queued before the current round, best class first */
+static sched_entry_t *sched_pick(void) {
+    for (int i = 0; i < SCHED_NCLASSES; i++) {
+        sched_class_t class = class_order[i];
+        sched_entry_t *e = runq[class].head;
+        if (e == NULL || e->round == sched_round) continue;
+        runq[class].head = e->next;
+        if (runq[class].head == NULL) runq[class].tail = NULL;
+        queued--;
+        return e;
+    }
+    return NULL;
+}
+
+bool sched_run(void) {
+    sched_round++;
+    sched_entry_t *e;
+    while ((e = sched_pick()) != NULL) {
+        coro_t coro = e->coro;
+        void *arg = e->arg;
+        e->next = free_entries;
+        free_entries = e;
+        set_coro_queued(coro, 0);
+        resume(coro, arg);
+    }
+    return queued > 0;
+}
+
+bool sched_pending(void) {
+    return queued > 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "picoro.h"
+
+/*
+ * Cooperative scheduler for SOS coroutines.
+ *
+ * Coroutines that are ready to continue are put on a run queue instead of
+ * being resumed straight from whatever event woke them up. The syscall loop
+ * drains the run queue between IPCs, highest class first.
+ */
+
+/* Scheduling classes, stored with the coroutine via set_coro_prio */
+typedef enum {
+    SCHED_SYSCALL = 0,      /* default for new coroutines */
+    SCHED_FAULT,            /* vm faults, run before anything else */
+    SCHED_BACKGROUND,       /* reclaim and process teardown */
+    SCHED_NCLASSES,
+} sched_class_t;
+
+/* Number of sched_yield_point calls between actual yields */
+#define SCHED_YIELD_INTERVAL 64
+
+/*
+ * Queue a suspended coroutine to be resumed with arg by sched_run.
+ * Falls back to resuming it immediately if the queue cannot grow.
+ */
+void sched_wake(coro_t coro, void *arg);
+
+/*
+ * Yield point for long running loops. Every SCHED_YIELD_INTERVAL calls
+ * the calling coroutine goes to the back of its class and lets everything
+ * else that is ready run first. Does nothing if coro is NULL.
+ */
+void sched_yield_point(coro_t coro);
+
+/*
+ * Go to the back of the calling coroutine's class and yield, e.g. to poll
+ * for some state owned by another coroutine to change.
+ */
+void sched_yield(coro_t coro);
+
+/*
+ * Resume ready coroutines, highest class first. Coroutines that are
+ * re-queued while this runs wait for the next call, so a busy coroutine
+ * cannot starve the syscall loop.
+ *
+ * @return true if the run queue is still non-empty
+ */
+bool sched_run(void);
+
+/* true if any coroutine is waiting on the run queue */
+bool sched_pending(void);
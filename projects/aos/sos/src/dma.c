@@ -54,6 +54,9 @@ uintptr_t sos_dma_phys_to_virt(uintptr_t phys)
 
 uintptr_t sos_dma_virt_to_phys(uintptr_t vaddr)
 {
+    if (vaddr < dma.vstart || vaddr - dma.vstart >= dma.pend - dma.pstart) {
+        return 0;
+    }
     return dma.pstart + (vaddr - dma.vstart);
 }
 
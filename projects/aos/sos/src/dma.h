@@ -49,6 +49,7 @@ uintptr_t sos_dma_phys_to_virt(uintptr_t phys);
  * Convert the provided virtual DMA address into a physical address
  *
  * @param address to convert
+ * @return 0 if the address is not DMA memory
  */
 uintptr_t sos_dma_virt_to_phys(uintptr_t virt);
 
@@ -23,6 +23,7 @@
 #include "elfload.h"
 #include "vm/addrspace.h"
 #include "vm/pagetable.h"
+#include "coroutine/sched.h"
 
 /*
  * Convert ELF permissions into seL4 permissions.
@@ -96,7 +97,7 @@ static int load_segment_into_vspace(addrspace_t *as, cspace_t *cspace, process_t
          * Note that while the standard permits segments to overlap, this should not occur if the segments
          * have different permissions - you should check this and return an error if this case is detected. */
         if (err == seL4_DeleteFirst) {
-            region_t *r = get_region(as->regions, loadee_vaddr);
+            region_t *r = get_region(as, loadee_vaddr);
             if (r->rights.words[0] != permissions.words[0] || r->attrs != attr) {
                 ZF_LOGE("wrong perm");
                 return -1;
@@ -167,6 +168,9 @@ static int load_segment_into_vspace(addrspace_t *as, cspace_t *cspace, process_t
         offset += segment_bytes;
 
         if (!pinned) unpin_frame(loadee_pte.frame);
+
+        /* zero filling a large bss can take a while */
+        sched_yield_point(coro);
     }
     return 0;
 }
@@ -7,6 +7,7 @@
 #include "utils/rollingarray.h"
 #include "utils/page.h"
 #include "../coroutine/picoro.h"
+#include "../coroutine/sched.h"
 #include <sel4/sel4.h>
 #include "../process.h"
 
@@ -72,7 +73,7 @@ static void console_read_handler(struct serial *serial, char c) {
         if (blocked_reader) {
             coro_t c = blocked_reader;
             blocked_reader = NULL;
-            resume(c, NULL);
+            sched_wake(c, NULL);
         }
     }
 }
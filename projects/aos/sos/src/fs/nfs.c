@@ -81,23 +81,32 @@ int sos_nfs_open(vnode_t *object, char *pathname, int flags_from_open, vnode_t *
     return cb_ret.status;
 }
 
+/*
+ * The reads have libnfs receive the data straight into uio->iovec.base, a
+ * user or page cache frame, rather than copying it out of the reply.
+ */
 int sos_nfs_read(vnode_t *file, struct uio *uio, process_t *proc, coro_t me) {
     res_cb_t cb_ret = {
         .coro = me,
         .status = 0,
         .data = NULL
     };
-    if (nfs_read_async(sos_nfs, (struct nfsfh *) file->data, uio->iovec.len, sos_nfs_cb, &cb_ret) < 0) return -1;
+    if (nfs_read_into_async(sos_nfs, (struct nfsfh *) file->data, uio->iovec.len, uio->iovec.base,
+                            sos_nfs_cb, &cb_ret) < 0) return -1;
     yield(NULL);
     if (cb_ret.status >= 0) {
         uio->iovec.len = cb_ret.status;
-        memcpy(uio->iovec.base, cb_ret.data, cb_ret.status);
     } else {
         ZF_LOGE("Error reading from NFS: %s", cb_ret.data);
     }
     return cb_ret.status;
 }
 
+/*
+ * libnfs sends the data straight from uio->iovec.base rather than copying it
+ * into the RPC, so the writes below keep the buffer mapped (and, for user
+ * buffers, pinned) until the reply comes back.
+ */
 int sos_nfs_write(vnode_t *file, struct uio *uio, coro_t me) {
     res_cb_t cb_ret = {
         .coro = me,
@@ -118,11 +127,11 @@ int sos_nfs_pread(vnode_t *file, struct uio *uio, coro_t me) {
         .status = 0,
         .data = NULL
     };
-    if (nfs_pread_async(sos_nfs, (struct nfsfh *) file->data, uio->offset, uio->iovec.len, sos_nfs_cb, &cb_ret) < 0) return -1;
+    if (nfs_pread_into_async(sos_nfs, (struct nfsfh *) file->data, uio->offset, uio->iovec.len, uio->iovec.base,
+                             sos_nfs_cb, &cb_ret) < 0) return -1;
     yield(NULL);
     if (cb_ret.status >= 0) {
         uio->iovec.len = cb_ret.status;
-        memcpy(uio->iovec.base, cb_ret.data, cb_ret.status);
     } else {
         ZF_LOGE("Error reading from NFS: %s", cb_ret.data);
     }
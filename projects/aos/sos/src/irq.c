@@ -145,6 +145,50 @@ int sos_register_irq_handler(
     return 0;
 }
 
+int sos_register_soft_irq(
+    sos_irq_callback_t callback,
+    void *data,
+    seL4_CPtr *notification
+)
+{
+    unsigned long ident_bit = alloc_irq_bit();
+    if (ident_bit >= seL4_BadgeBits) {
+        ZF_LOGE("Exhausted IRQ notification bits for soft IRQ");
+        return ENOMEM;
+    }
+
+    seL4_CPtr notification_cptr = cspace_alloc_slot(irq_dispatch.cspace);
+    if (notification_cptr == 0) {
+        ZF_LOGE("Could not allocate notification slot for soft IRQ");
+        free_irq_bit(ident_bit);
+        return ENOMEM;
+    }
+
+    seL4_Word badge = irq_dispatch.flag_bits | BIT(ident_bit);
+
+    seL4_Error err = cspace_mint(irq_dispatch.cspace, notification_cptr, irq_dispatch.cspace,
+                                 irq_dispatch.notification, seL4_CanWrite, badge);
+    if (err != 0) {
+        ZF_LOGE("Could not mint notification for soft IRQ");
+        cspace_free_slot(irq_dispatch.cspace, notification_cptr);
+        free_irq_bit(ident_bit);
+        return err;
+    }
+
+    irq_handlers[ident_bit] = (irq_handler_t) {
+        .irq = 0,
+        .irq_handler = seL4_CapNull,
+        .notification = notification_cptr,
+        .callback = callback,
+        .data = data,
+    };
+
+    *notification = notification_cptr;
+
+    ZF_LOGI("Registered soft IRQ with badge 0x%lX", badge);
+    return 0;
+}
+
 int sos_handle_irq_notification(seL4_Word *badge)
 {
     unsigned long unchecked_bits =
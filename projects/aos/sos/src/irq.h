@@ -70,6 +70,22 @@ int sos_register_irq_handler(
     seL4_IRQHandler *irq_handler
 );
 
+/*
+ * Register a handler for a badge bit that is signalled by software
+ * rather than by an IRQ, e.g. by a driver process. The callback is passed
+ * irq 0 and a null IRQHandler.
+ *
+ * @callback        Callback to trigger when the bit is signalled.
+ * @data            Data to pass to the callback.
+ * @notification    Set to a badged notification cap in SOS's cspace, to be
+ *                  copied to whoever should signal it.
+ */
+int sos_register_soft_irq(
+    sos_irq_callback_t callback,
+    void *data,
+    seL4_CPtr *notification
+);
+
 /*
  * Handle all IRQs triggered by a notification.
  *
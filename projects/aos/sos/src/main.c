@@ -10,6 +10,7 @@
  * @TAG(DATA61_GPL)
  */
 #include <autoconf.h>
+#include <sos/gen_config.h>
 #include <utils/util.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,7 +21,7 @@
 #include <aos/sel4_zf_logif.h>
 #include <aos/debug.h>
 
-// #include <clock/clock.h>
+#include <clock/clock.h>
 #include <clock/device.h>
 #include <cpio/cpio.h>
 #include <serial/serial.h>
@@ -41,8 +42,11 @@
 #include "utils.h"
 #include "process.h"
 #include "syscalls/syscall.h"
+#include "syscalls/time.h"
+#include "syscalls/ring.h"
 #include "fs/console.h"
 #include "vm/fault_handler.h"
+#include "coroutine/sched.h"
 
 #include <aos/vsyscall.h>
 
@@ -59,9 +63,6 @@
 #define IRQ_IDENT_BADGE_BITS MASK(seL4_BadgeBits - 1ul)
 
 
-#define MAX_CONCURRENT_IRQS 10
-
-
 /* provided by gcc */
 extern void (__register_frame)(void *);
 
@@ -77,65 +78,23 @@ static seL4_CPtr ipc_ep;
 seL4_CPtr timer_ep;
 seL4_IRQHandler *timer_irq_handler;
 
-typedef void (*timer_callback_t)(uint32_t id, void *data);
-extern pid_t clock_driver_pid;
-
-int timer_irq(
+static int sos_timer_irq(
     void *data,
     seL4_Word irq,
     seL4_IRQHandler irq_handler
 ) {
+#ifdef CONFIG_SOS_INTERNAL_TIMER
+    /* expiry callbacks only queue coroutines, so run them right here */
+    timer_irq();
+#else
     if (!is_clock_driver_ready()) {
         ZF_LOGE("Got timer IRQ but timer driver is not ready");
         return seL4_IRQHandler_Ack(irq_handler);
     }
-    seL4_Word irq_badge_queue[MAX_CONCURRENT_IRQS];
-    int irq_queue_len = -1;
+    /* kick the driver, whatever expired comes back through the timer ring */
     seL4_Send(timer_ep, seL4_MessageInfo_new(0, 0, 0, 1));
-    seL4_Word badge = 0;
-    // stupid mcs, how do i call recv without a reply obj
-    // i don't want to reply cuz i'm mean
-    seL4_CPtr reply;
-    ut_t *reply_ut = alloc_retype(&reply, seL4_ReplyObject, seL4_ReplyBits);
-    while (1) {
-        seL4_MessageInfo_t msg = seL4_Recv(timer_ep, &badge, reply);
-        // printf("%d %d\n", seL4_MessageInfo_get_label(msg), seL4_MessageInfo_get_length(msg));
-        // printf("%ld %ld %ld %ld\n", badge, seL4_GetMR(0), seL4_GetMR(1), seL4_GetMR(2));
-        if (badge & IRQ_EP_BADGE) {
-            /* It's a notification from our bound notification
-             * object! We can't handle this here since irq handler could potentially block the kernel
-             * by calling into clock driver again. instead, we add it to a queue and deal with them
-             * after we finish handling timer irq */
-            if (++irq_queue_len == MAX_CONCURRENT_IRQS) {
-                ZF_LOGF("too many IRQs in timer_irq routine. Please increase MAX_CONCURRENT_IRQS");
-            }
-            // printf("queueing irq %ld\n", badge);
-            irq_badge_queue[irq_queue_len] = badge;
-            continue;
-        }
-        if (badge != PID_TO_BADGE(clock_driver_pid)) {
-            // printf("badge %ld != clock %ld", badge, PID_TO_BADGE(clock_driver_pid));
-            continue;
-        }
-        if (seL4_MessageInfo_get_length(msg) == 3) {
-            unsigned int id = seL4_GetMR(0);
-            timer_callback_t cb = seL4_GetMR(1);
-            void *data = seL4_GetMR(2);
-            cb(id, data);
-        } else {
-            break;
-        }
-    }
-    cspace_delete(&cspace, reply);
-    cspace_free_slot(&cspace, reply);
-    ut_free(reply_ut);
-    seL4_Error ack_err = seL4_IRQHandler_Ack(irq_handler);
-    for (int i = 0; i <= irq_queue_len; i++) {
-        sos_handle_irq_notification(irq_badge_queue + i);
-    }
-    if (ack_err != seL4_NoError) return ack_err;
-
-    return seL4_NoError;
+#endif
+    return seL4_IRQHandler_Ack(irq_handler);
 }
 
 NORETURN void syscall_loop(seL4_CPtr ep)
@@ -147,18 +106,52 @@ NORETURN void syscall_loop(seL4_CPtr ep)
         " / / / /  / /| |/ / / /_/ / / /_/ /___/ / \n"
         "/_/ /_/  /_/ |___/_/\\__,_/_/\\____//____/ \n" 
     );
+    seL4_CPtr reply;
+    ut_t *reply_ut = NULL;
+    /* set when the last message was handled without blocking and still
+     * needs its reply, which goes out through reply */
+    bool reply_pending = false;
+    seL4_MessageInfo_t reply_msg;
     while (1) {
-        seL4_CPtr reply;
-        /* Create reply object */
-        ut_t *reply_ut = alloc_retype(&reply, seL4_ReplyObject, seL4_ReplyBits);
         if (reply_ut == NULL) {
-            ZF_LOGF("Failed to alloc reply object ut");
+            /* Get a reply object */
+            reply_ut = reply_alloc(&reply);
+            if (reply_ut == NULL) {
+                ZF_LOGF("Failed to alloc reply object ut");
+            }
         }
 
+        if (reply_pending && (sched_pending() || network_flush_pending())) {
+            /* answer now, ready coroutines or the NFS callbacks run by
+             * network_flush would clobber the message registers */
+            seL4_Send(reply, reply_msg);
+            reply_pending = false;
+        }
+
+        /* fatal faults we could not get a coroutine for last time; the
+         * coroutines must not clobber a pending reply */
+        if (!reply_pending) retry_fault_kills();
+
+        /* get NFS requests made by the coroutines that just ran on the wire */
+        network_flush();
+
         seL4_Word badge = 0;
-        /* Block on ep, waiting for an IPC sent over ep, or
-         * a notification from our bound notification object */
-        seL4_MessageInfo_t message = seL4_Recv(ep, &badge, reply);
+        seL4_MessageInfo_t message;
+        if (reply_pending) {
+            /* Reply and wait for the next message in one go, so the common
+             * case can stay on the kernel fastpath */
+            message = seL4_ReplyRecv(ep, reply_msg, &badge, reply);
+            reply_pending = false;
+        } else if (sched_run()) {
+            /* Coroutines are still ready, so only poll for new work. Nothing
+             * we accept on ep has a zero badge, so that means no message. */
+            message = seL4_NBRecv(ep, &badge, reply);
+            if (badge == 0) continue;
+        } else {
+            /* Block on ep, waiting for an IPC sent over ep, or
+             * a notification from our bound notification object */
+            message = seL4_Recv(ep, &badge, reply);
+        }
         /* Awake! We got a message - check the label and badge to
          * see what the message is about */
         seL4_Word label = seL4_MessageInfo_get_label(message);
@@ -172,17 +165,20 @@ NORETURN void syscall_loop(seL4_CPtr ep)
             /* It's a notification from our bound notification
              * object! */
             sos_handle_irq_notification(&badge);
-            cspace_delete(&cspace, reply);
-            cspace_free_slot(&cspace, reply);
-            ut_free(reply_ut);
+            /* the reply object was not used, keep it for the next message */
         } else if (label == seL4_Fault_VMFault) {
             // debug_print_fault(message, proc->command);
             seL4_Fault_t fault = seL4_getFault(message);
-            handle_vm_fault(&cspace, seL4_Fault_VMFault_get_Addr(fault), seL4_Fault_VMFault_get_FSR(fault), proc, reply, reply_ut);
+            reply_pending = handle_vm_fault(&cspace, seL4_Fault_VMFault_get_Addr(fault), seL4_Fault_VMFault_get_FSR(fault),
+                                            proc, reply, reply_ut);
+            reply_msg = seL4_MessageInfo_new(0, 0, 0, 0);
+            if (!reply_pending) reply_ut = NULL;
         } else if (label == seL4_Fault_NullFault) {
             /* It's not a fault or an interrupt, it must be an IPC
              * message from tty_test! */
-            handle_syscall(&cspace, badge, seL4_MessageInfo_get_length(message) - 1, reply, reply_ut, proc);
+            reply_pending = handle_syscall(&cspace, badge, seL4_MessageInfo_get_length(message) - 1, reply, reply_ut, proc,
+                                           &reply_msg);
+            if (!reply_pending) reply_ut = NULL;
         } else {
             debug_print_fault(message, proc->command);
             ZF_LOGE("fault with badge %ld!\n", badge);
@@ -298,14 +294,16 @@ NORETURN void *main_continued(UNUSED void *arg)
     network_init(&cspace, timer_vaddr, ntfn, start_sosh);
 
     /* Initialises the timer */
-    // printf("Timer init\n");
-    // start_timer(timer_vaddr);
-    /* You will need to register an IRQ handler for the timer here.
-     * See "irq.h". */
-    sos_register_irq_handler(42, true, timer_irq, NULL, timer_irq_handler);
+#ifdef CONFIG_SOS_INTERNAL_TIMER
+    start_timer(timer_vaddr);
+#else
+    timer_ring_init();
+#endif
+    sos_register_irq_handler(meson_timeout_irq(MESON_TIMER_A), true, sos_timer_irq, NULL, timer_irq_handler);
 
     /* Initialize syscall table */
     init_syscall();
+    ring_init();
 
     /* Initialize console */
     console_init();
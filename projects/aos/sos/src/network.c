@@ -14,6 +14,7 @@
 #include <autoconf.h>
 #include <sos/gen_config.h>
 #include <assert.h>
+#include <stdbool.h>
 #include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
@@ -46,6 +47,7 @@
 #include "dma.h"
 #include "mapping.h"
 #include "irq.h"
+#include "pktpool.h"
 #include "ut.h"
 #include "fs/nfs.h"
 #include "vm/frame_table.h"
@@ -60,7 +62,18 @@
 #endif
 
 #define NETWORK_IRQ (40)
-#define WATCHDOG_TIMEOUT 1000
+
+/*
+ * Bounds of the fallback network tick. The watchdog is a one-shot aimed at
+ * the next picotcp timer, but never further out than the fallback period,
+ * which starts at NETWORK_TICK_MIN_US and doubles every tick that finds
+ * nothing to do. The watchdog counts 16 bits of microseconds.
+ */
+#define NETWORK_TICK_MIN_US 1000
+#define NETWORK_TICK_MAX_US 64000
+
+/* extra stack ticks per IRQ to work through a burst of received frames */
+#define NETWORK_RX_ROUNDS 4
 
 #define DHCP_STATUS_WAIT        0
 #define DHCP_STATUS_FINISHED    1
@@ -71,6 +84,12 @@ static struct nfs_context *nfs = NULL;
 static int dhcp_status = DHCP_STATUS_WAIT;
 static char nfs_dir_buf[PATH_MAX];
 static uint8_t ip_octet;
+/* current fallback period of the watchdog */
+static uint32_t tick_us = NETWORK_TICK_MIN_US;
+/* something arrived or NFS had work since the last tick */
+static bool network_active;
+/* the watchdog is running */
+static bool ticking;
 
 static void nfs_mount_cb(int status, struct nfs_context *nfs, void *data, void *private_data);
 
@@ -85,28 +104,51 @@ static int pico_eth_send(UNUSED struct pico_device *dev, void *input_buf, int le
     return len;
 }
 
-static int pico_eth_poll(UNUSED struct pico_device *dev, int loop_score)
+static void pico_eth_tx_done(void *cookie)
 {
-    while (loop_score > 0) {
-        int len;
-        int retval = ethif_recv(&len); /* This will internally call 'raw_recv_callback'
-                                        * (if a packet is actually available) */
-        if (retval == ETHIF_ERROR || len == 0) {
-            break;
-        }
-        loop_score--;
+    pico_frame_discard(cookie);
+}
+
+/* Send from the frame's own memory when it is DMA memory, copy otherwise */
+static int pico_eth_send_frame(struct pico_device *dev, struct pico_frame *f)
+{
+    if (sos_dma_virt_to_phys((uintptr_t) f->start) == 0) {
+        return pico_eth_send(dev, f->start, f->len);
+    }
+
+    /* keep the buffer alive until the device is done with it */
+    struct pico_frame *ref = pico_frame_copy(f);
+    if (ref == NULL) {
+        return pico_eth_send(dev, f->start, f->len);
     }
+    if (ethif_send_zerocopy(f->start, f->len, pico_eth_tx_done, ref) != ETHIF_NOERROR) {
+        pico_frame_discard(ref);
+        return pico_eth_send(dev, f->start, f->len);
+    }
+    return f->len;
+}
+
+static int pico_eth_poll(UNUSED struct pico_device *dev, int loop_score)
+{
+    /* This will internally call 'raw_recv_callback' for every packet received */
+    int received = ethif_poll(loop_score);
 
     /* return (original_loop_score - amount_of_packets_received) */
-    return loop_score;
+    return loop_score - received;
 }
 
-/* Called by ethernet driver when a frame is received (inside an ethif_recv()) */
-void raw_recv_callback(uint8_t *in_packet, int len)
+/* Called by ethernet driver when a frame is received (inside an ethif_poll()) */
+void raw_recv_callback(uint8_t *in_packet, int len, ethif_release_t release)
 {
-    /* Note that in_packet *must* be copied somewhere in this function, as the memory
-     * will be re-used by the ethernet driver after this function returns. */
-    pico_stack_recv(&pico_dev, in_packet, len);
+    if (release != NULL) {
+        /* picotcp hands the buffer back through release when it frees the frame */
+        pico_stack_recv_zerocopy_ext_buffer_notify(&pico_dev, in_packet, len, release);
+    } else {
+        /* Note that in_packet *must* be copied somewhere in this function, as the memory
+         * will be re-used by the ethernet driver after this function returns. */
+        pico_stack_recv(&pico_dev, in_packet, len);
+    }
+    network_active = true;
 }
 
 /* This is a bit of a hack - we need a DMA size field in the ethif driver. */
@@ -120,8 +162,31 @@ ethif_dma_addr_t ethif_dma_malloc(uint32_t size, uint32_t align)
     return eaddr;
 }
 
-void nfslib_poll()
+/* picotcp allocates frames through these, see pico_frame.h */
+void *pico_frame_mem_zalloc(size_t size)
+{
+    return pktpool_zalloc(size);
+}
+
+void pico_frame_mem_free(void *ptr)
+{
+    pktpool_free(ptr);
+}
+
+/* Packet pools come out of DMA memory, so frames can be sent without a copy */
+static void *pktpool_dma_alloc(size_t size, size_t align)
+{
+    return (void *) sos_dma_malloc(size, align).vaddr;
+}
+
+/* Returns true if NFS had something to do */
+static bool nfslib_poll(void)
 {
+    if (nfs == NULL) {
+        /* not mounting yet */
+        return false;
+    }
+
     struct pollfd pfd = {
         .fd = nfs_get_fd(nfs),
         .events = nfs_which_events(nfs)
@@ -135,18 +200,57 @@ void nfslib_poll()
     if (poll_ret == 0) {
         /* Nothing of interest to NFS happened on the IP stack since last
          * time we checked, so don't bother continuing */
-        return;
+        return false;
     }
 
     if (nfs_service(nfs, pfd.revents) < 0) {
         printf("nfs_service failed\n");
     }
+    return true;
+}
+
+/* Program the watchdog for the next picotcp timer, or the fallback tick if that is sooner */
+static void network_rearm(void)
+{
+    uint64_t timeout = tick_us;
+    pico_time expire;
+    if (pico_timer_next(&expire) == 0) {
+        pico_time now = PICO_TIME_MS();
+        /* a timer fires once its millisecond has passed */
+        uint64_t due = expire < now ? 0 : (expire - now + 1) * US_IN_MS;
+        if (due < timeout) timeout = due;
+    }
+    if (timeout < NETWORK_TICK_MIN_US) timeout = NETWORK_TICK_MIN_US;
+    watchdog_set(timeout);
 }
 
-static void network_tick_internal(void)
+static void network_service(void)
 {
+    /* hand what the driver received up the stack, and run due timers */
     pico_bsd_stack_tick();
-    nfslib_poll();
+    /* keep polling while the driver has a backlog, its RX IRQ is off until then */
+    for (int i = 0; i < NETWORK_RX_ROUNDS && ethif_rx_pending(); i++) {
+        pico_bsd_stack_tick();
+    }
+    if (nfslib_poll()) {
+        network_active = true;
+        /* send whatever NFS queued now, rather than on the next tick */
+        pico_bsd_stack_tick();
+    }
+}
+
+bool network_flush_pending(void)
+{
+    return nfs != NULL && (nfs_which_events(nfs) & POLLOUT);
+}
+
+void network_flush(void)
+{
+    if (!network_flush_pending()) return;
+    network_service();
+    /* the replies come in through the IRQ, but retransmits need the tick */
+    tick_us = NETWORK_TICK_MIN_US;
+    network_rearm();
 }
 
 /* Handler for IRQs from the ethernet MAC */
@@ -158,7 +262,11 @@ static int network_irq(
 {
     ethif_irq();
     seL4_IRQHandler_Ack(irq_handler);
-    pico_bsd_stack_tick();
+    network_service();
+    if (ticking) {
+        tick_us = NETWORK_TICK_MIN_US;
+        network_rearm();
+    }
     return 0;
 }
 
@@ -169,8 +277,15 @@ static int network_tick(
     seL4_IRQHandler irq_handler
 )
 {
-    network_tick_internal();
-    watchdog_reset();
+    network_service();
+    if (network_active || (nfs != NULL && nfs_queue_length(nfs) > 0)) {
+        tick_us = NETWORK_TICK_MIN_US;
+    } else if (tick_us < NETWORK_TICK_MAX_US) {
+        /* idle, back off */
+        tick_us = MIN(tick_us * 2, NETWORK_TICK_MAX_US);
+    }
+    network_active = false;
+    network_rearm();
     seL4_IRQHandler_Ack(irq_handler);
     return 0;
 }
@@ -235,6 +350,7 @@ void network_init(cspace_t *cspace, void *timer_vaddr, seL4_CPtr irq_ntfn, void
     ethif_dma_ops.dma_phys_to_virt = &sos_dma_phys_to_virt;
     ethif_dma_ops.flush_dcache_range = &sos_dma_cache_clean_invalidate;
     ethif_dma_ops.invalidate_dcache_range = &sos_dma_cache_invalidate;
+    ethif_dma_ops.dma_virt_to_phys = &sos_dma_virt_to_phys;
 
     /* Try initializing the device.
      *
@@ -245,12 +361,14 @@ void network_init(cspace_t *cspace, void *timer_vaddr, seL4_CPtr irq_ntfn, void
     error = ethif_init(eth_base_vaddr, mac_addr, &ethif_dma_ops, &raw_recv_callback);
     ZF_LOGF_IF(error != 0, "Failed to initialise ethernet interface");
 
+    pktpool_init(pktpool_dma_alloc);
     pico_bsd_init();
     pico_stack_init();
 
     memset(&pico_dev, 0, sizeof(struct pico_device));
 
     pico_dev.send = pico_eth_send;
+    pico_dev.send_frame = pico_eth_send_frame;
     pico_dev.poll = pico_eth_poll;
 
     pico_dev.mtu = MAXIMUM_TRANSFER_UNIT;
@@ -276,9 +394,10 @@ void network_init(cspace_t *cspace, void *timer_vaddr, seL4_CPtr irq_ntfn, void
         }
     } while (dhcp_status != DHCP_STATUS_FINISHED);
 
-    /* Configure a watchdog IRQ for 1 millisecond from now. Whenever the watchdog is reset
-     * using watchdog_reset(), we will get another IRQ 1ms later */
-    watchdog_init(timer_vaddr, WATCHDOG_TIMEOUT);
+    /* Start the network tick. Every IRQ from here on programs the watchdog
+     * for the next one, see network_rearm() */
+    watchdog_init(timer_vaddr, NETWORK_TICK_MIN_US);
+    ticking = true;
 
     nfs = nfs_init_context();
     ZF_LOGF_IF(nfs == NULL, "Failed to init NFS context");
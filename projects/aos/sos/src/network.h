@@ -11,6 +11,7 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <sel4/types.h>
 #include <cspace/cspace.h>
 
@@ -20,8 +21,22 @@
  * @param cspace         for creating slots for mappings
  * @param ntfn_irq       badged notification object bound to SOS's endpoint, for ethernet IRQs
  * @param ntfn_tick      badged notification object bound to SOS's endpoint, for network tick IRQs
- * @param timer_vaddr    mapped timer device. network_init will set up a periodic network_tick
- *                       using the SoC's watchdog timer (which is not used by your timer driver
- *                       and has a completely different programming model!)
+ * @param timer_vaddr    mapped timer device. network_init will set up a network tick using
+ *                       the SoC's watchdog timer (which is not used by your timer driver and
+ *                       has a completely different programming model!), programmed for the
+ *                       next picotcp timer and backing off while the network is idle
  */
 void network_init(cspace_t *cspace, void *timer_vaddr, seL4_CPtr irq_ntfn, void (*init_cb)());
+
+/**
+ * Sends out NFS requests queued since the last network IRQ. Call before
+ * blocking, as nothing else would get them moving until the next tick.
+ * This runs NFS callbacks, which resume coroutines that may use the
+ * message registers.
+ */
+void network_flush(void);
+
+/**
+ * True if network_flush has NFS requests to send.
+ */
+bool network_flush_pending(void);
@@ -0,0 +1,124 @@
+#include <autoconf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/util.h>
+
+#include "pktpool.h"
+
+/* NOTE: NOT THREAD SAFE */
+
+/* objects do not share cache lines with their neighbours' headers more than they must */
+#define PKTPOOL_ALIGN 64
+
+/* Every object is preceded by one of these */
+typedef struct obj {
+    struct pool *pool;      /* NULL if the object came from the heap */
+    struct obj *next;       /* next free object, while on the free list */
+} obj_t;
+
+typedef struct pool {
+    pktpool_stats_t stats;
+    size_t max;             /* most objects the pool grows to */
+    size_t chunk;           /* objects added at a time */
+    obj_t *free;
+} pool_t;
+
+/* Smallest first. Objects are 64B, 256B, 2KiB and 16KiB with their header */
+static pool_t pools[PKTPOOL_CLASSES] = {
+    { .stats = { .name = "counter", .size = 64 - sizeof(obj_t) },    .max = 1024, .chunk = 64 },
+    { .stats = { .name = "small",   .size = 256 - sizeof(obj_t) },   .max = 512,  .chunk = 16 },
+    { .stats = { .name = "mtu",     .size = 2048 - sizeof(obj_t) },  .max = 256,  .chunk = 2 },
+    { .stats = { .name = "large",   .size = 16384 - sizeof(obj_t) }, .max = 8,    .chunk = 1 },
+};
+
+static void *(*pool_mem_alloc)(size_t size, size_t align) = NULL;
+
+void pktpool_init(void *(*alloc)(size_t size, size_t align))
+{
+    pool_mem_alloc = alloc;
+}
+
+static void pool_grow(pool_t *pool)
+{
+    size_t n = MIN(pool->chunk, pool->max - pool->stats.total);
+    if (n == 0 || pool_mem_alloc == NULL) return;
+
+    size_t objsize = sizeof(obj_t) + pool->stats.size;
+    uint8_t *mem = pool_mem_alloc(n * objsize, PKTPOOL_ALIGN);
+    if (mem == NULL) {
+        /* no more memory to be had, stop asking */
+        ZF_LOGW("packet pool %s stuck at %zu objects", pool->stats.name, pool->stats.total);
+        pool->max = pool->stats.total;
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        obj_t *obj = (obj_t *) (mem + i * objsize);
+        obj->pool = pool;
+        obj->next = pool->free;
+        pool->free = obj;
+    }
+    pool->stats.total += n;
+}
+
+void *pktpool_zalloc(size_t size)
+{
+    obj_t *obj = NULL;
+    for (int i = 0; i < PKTPOOL_CLASSES; i++) {
+        pool_t *pool = &pools[i];
+        if (size > pool->stats.size) continue;
+
+        if (pool->free == NULL) pool_grow(pool);
+        obj = pool->free;
+        if (obj == NULL) {
+            pool->stats.fallbacks++;
+#ifdef CONFIG_DEBUG_BUILD
+            if (pool->stats.fallbacks == 1) {
+                ZF_LOGW("packet pool %s exhausted, falling back to the heap", pool->stats.name);
+                pktpool_print_stats();
+            }
+#endif
+            break;
+        }
+        pool->free = obj->next;
+        pool->stats.allocs++;
+        pool->stats.in_use++;
+        if (pool->stats.in_use > pool->stats.peak) pool->stats.peak = pool->stats.in_use;
+        break;
+    }
+
+    if (obj == NULL) {
+        obj = malloc(sizeof(obj_t) + size);
+        if (obj == NULL) return NULL;
+        obj->pool = NULL;
+    }
+    obj->next = NULL;
+    memset(obj + 1, 0, size);
+    return obj + 1;
+}
+
+void pktpool_free(void *ptr)
+{
+    if (ptr == NULL) return;
+
+    obj_t *obj = (obj_t *) ptr - 1;
+    pool_t *pool = obj->pool;
+    if (pool == NULL) {
+        free(obj);
+        return;
+    }
+    obj->next = pool->free;
+    pool->free = obj;
+    pool->stats.in_use--;
+}
+
+void pktpool_print_stats(void)
+{
+    printf("%-8s %6s %6s %6s %6s %10s %9s\n", "pool", "size", "total", "in use", "peak", "allocs", "fallbacks");
+    for (int i = 0; i < PKTPOOL_CLASSES; i++) {
+        pktpool_stats_t *s = &pools[i].stats;
+        printf("%-8s %6zu %6zu %6zu %6zu %10zu %9zu\n", s->name, s->size, s->total, s->in_use, s->peak,
+               s->allocs, s->fallbacks);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Slab pools for picotcp's frames and frame buffers.
+ *
+ * picotcp allocates a struct pico_frame and a buffer for every packet it
+ * sends or receives. pktpool_zalloc serves those from fixed size classes
+ * instead of the general heap: a small one for usage counters, one for
+ * frame structs and short frames, one for MTU sized frames and one for
+ * reassembled datagrams. Pools grow a chunk at a time with memory from the
+ * hook given to pktpool_init and never shrink, up to a limit per pool.
+ * Requests that fit no pool, or find theirs exhausted, go to the heap.
+ */
+
+typedef struct {
+    const char *name;
+    size_t size;        /* usable bytes per object */
+    size_t total;       /* objects carved out so far */
+    size_t in_use;
+    size_t peak;        /* most objects in use at once */
+    size_t allocs;      /* allocations served by this pool */
+    size_t fallbacks;   /* allocations sent to the heap as the pool was full */
+} pktpool_stats_t;
+
+#define PKTPOOL_CLASSES 4
+
+/*
+ * Set up the pools. alloc returns size bytes of memory aligned to align, or
+ * NULL, and is only called when a pool needs to grow.
+ */
+void pktpool_init(void *(*alloc)(size_t size, size_t align));
+
+/* Returns size zeroed bytes, from a pool if possible */
+void *pktpool_zalloc(size_t size);
+
+/* Frees memory from pktpool_zalloc */
+void pktpool_free(void *ptr);
+
+/*
+ * Prints the statistics of every pool. Debug builds do this by themselves
+ * the first time a pool runs out and sends a request to the heap.
+ */
+void pktpool_print_stats(void);
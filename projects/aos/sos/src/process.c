@@ -1,4 +1,5 @@
 #include <aos/debug.h>
+#include <sos/gen_config.h>
 #include <cpio/cpio.h>
 #include <elf/elf.h>
 #include <fcntl.h>
@@ -17,18 +18,36 @@
 #include "utils.h"
 #include "vfs/file.h"
 #include "vm/pagetable.h"
-#include "utils/rolling_id.h"
+#include "coroutine/sched.h"
+#include "syscalls/ring.h"
+#include "syscalls/time.h"
+#include <cspace/bitfield.h>
 
 /**
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % MAX_PROCS), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is a chained hash table keyed by pid. The bucket
+ * array is doubled whenever the average chain length goes above
+ * PROC_HASH_MAX_LOAD, so lookups stay O(1) no matter how many processes
+ * are alive. Live processes are also kept on a doubly-linked list so
+ * that process_status only ever touches processes that exist.
+ *
+ * Pids come from a counter until MAX_PID is reached, after which freed
+ * pids are recycled in FIFO order from a ring. Both are O(1), and a pid
+ * is never handed out again until every other free pid has been used.
+ *
+ * pid_exited remembers which pids belong to processes that have exited
+ * and whose pid has not been reused yet, so process_wait on a dead
+ * process returns immediately.
  */
-pid_t oldpids[MAX_PROCS];
-process_t runprocs[MAX_PROCS];
-static bool rid_inused[MAX_PID];
-static rid_t proc_rid;
+static process_t **proc_buckets;
+static size_t proc_nbuckets;
+static size_t proc_count;
+static process_t *proc_live;
+
+static uint16_t pid_free[MAX_PID];
+static size_t pid_free_head;
+static size_t pid_free_len;
+static pid_t pid_next_fresh;
+static unsigned long pid_exited[DIV_ROUND_UP(MAX_PID + 1, WORD_BITS)];
 
 static seL4_CPtr ipc_ep;
 static seL4_CPtr timer_ep;
@@ -36,16 +55,21 @@ static seL4_CPtr timer_ep;
 pid_t clock_driver_pid = -1;
 
 extern seL4_CPtr timer_cptr;
+extern void *timer_vaddr;
 
 bool is_clock_driver_ready() {
+#ifdef CONFIG_SOS_INTERNAL_TIMER
+    /* started before any process */
+    return true;
+#else
     return clock_driver_pid >= 0;
+#endif
 }
 
-unsigned get_time() {
-    if (is_clock_driver_ready()) {
-        seL4_Call(timer_ep, seL4_MessageInfo_new(0, 0, 0, 0));
-        return seL4_GetMR(0);
-    }
+uint64_t get_time() {
+    /* the driver sets timer E to count microseconds when it starts, after
+     * that we can read it ourselves */
+    if (is_clock_driver_ready()) return meson_timestamp(timer_vaddr);
     /* if clock driver gets killed, we auto-respawn it */
     /* for simplicity, we always set stime of clock driver to 0 */
     /* even if it is respawned. */
@@ -56,39 +80,137 @@ unsigned get_time() {
 }
 
 void process_init() {
-    if (rid_init(&proc_rid, rid_inused, MAX_PID, 1) < 0) {
-        ZF_LOGF("can't init pid");
-    }
-    memset(runprocs, 0, sizeof(runprocs));
-    memset(oldpids, 0, sizeof(oldpids));
+    proc_nbuckets = PROC_HASH_INIT_BUCKETS;
+    proc_buckets = calloc(proc_nbuckets, sizeof(process_t *));
+    if (proc_buckets == NULL) {
+        ZF_LOGF("can't init process table");
+    }
+    proc_count = 0;
+    proc_live = NULL;
+    pid_free_head = pid_free_len = 0;
+    pid_next_fresh = 1;
+    memset(pid_exited, 0, sizeof(pid_exited));
     global_exit_blocked = NULL;
 }
 
+static inline size_t proc_bucket(pid_t pid, size_t nbuckets) {
+    /* pids are handed out sequentially, so the low bits spread them evenly */
+    return pid & (nbuckets - 1);
+}
+
+static void proc_table_grow() {
+    size_t nbuckets = proc_nbuckets * 2;
+    process_t **buckets = calloc(nbuckets, sizeof(process_t *));
+    /* not fatal, we just get longer chains */
+    if (buckets == NULL) return;
+    for (size_t i = 0; i < proc_nbuckets; i++) {
+        process_t *curr = proc_buckets[i];
+        while (curr != NULL) {
+            process_t *next = curr->hash_next;
+            size_t b = proc_bucket(curr->pid, nbuckets);
+            curr->hash_next = buckets[b];
+            buckets[b] = curr;
+            curr = next;
+        }
+    }
+    free(proc_buckets);
+    proc_buckets = buckets;
+    proc_nbuckets = nbuckets;
+}
+
+static void proc_table_insert(process_t *proc) {
+    if (proc_count + 1 > proc_nbuckets * PROC_HASH_MAX_LOAD) proc_table_grow();
+    size_t b = proc_bucket(proc->pid, proc_nbuckets);
+    proc->hash_next = proc_buckets[b];
+    proc_buckets[b] = proc;
+
+    proc->live_prev = NULL;
+    proc->live_next = proc_live;
+    if (proc_live) proc_live->live_prev = proc;
+    proc_live = proc;
+    proc_count++;
+}
+
+static void proc_table_remove(process_t *proc) {
+    process_t **curr = &proc_buckets[proc_bucket(proc->pid, proc_nbuckets)];
+    while (*curr != NULL && *curr != proc) curr = &((*curr)->hash_next);
+    assert(*curr == proc);
+    *curr = proc->hash_next;
+
+    if (proc->live_prev) proc->live_prev->live_next = proc->live_next;
+    else proc_live = proc->live_next;
+    if (proc->live_next) proc->live_next->live_prev = proc->live_prev;
+    proc_count--;
+}
+
+static pid_t pid_alloc() {
+    pid_t pid;
+    if (pid_next_fresh <= MAX_PID) {
+        pid = pid_next_fresh++;
+    } else if (pid_free_len > 0) {
+        pid = pid_free[pid_free_head];
+        pid_free_head = (pid_free_head + 1) % MAX_PID;
+        pid_free_len--;
+    } else {
+        return -1;
+    }
+    bf_clr_bit(pid_exited, pid);
+    return pid;
+}
+
+static void pid_release(pid_t pid) {
+    assert(pid_free_len < MAX_PID);
+    pid_free[(pid_free_head + pid_free_len) % MAX_PID] = pid;
+    pid_free_len++;
+}
+
 process_t *get_process_by_pid(pid_t pid) {
-    if (runprocs[pid % MAX_PROCS].pid == pid)
-        return &runprocs[pid % MAX_PROCS];
-    return NULL;
+    if (pid <= 0 || pid > MAX_PID) return NULL;
+    process_t *curr = proc_buckets[proc_bucket(pid, proc_nbuckets)];
+    while (curr != NULL && curr->pid != pid) curr = curr->hash_next;
+    return curr;
 }
 
-pid_t get_next_pid() {
-    for (int i = 0; i < MAX_PROCS; i++) {
-        pid_t ret = rid_get_id(&proc_rid);
-        if (ret == -1) return -1;
-        if (runprocs[ret % MAX_PROCS].state == PROC_FREE) return ret;
-        rid_remove_id(&proc_rid, ret);
+size_t process_count() {
+    return proc_count;
+}
+
+/* allocate a new process with a fresh pid and add it to the process table */
+static process_t *process_alloc() {
+    process_t *proc = malloc(sizeof(process_t));
+    if (proc == NULL) return NULL;
+    memset(proc, 0, sizeof(process_t));
+    proc->pid = pid_alloc();
+    if (proc->pid == -1) {
+        free(proc);
+        return NULL;
     }
-    return -1;
+    proc->state = PROC_CREATING;
+    proc_table_insert(proc);
+    return proc;
+}
+
+/* remove a process from the process table and release its pid */
+static void process_unlink(process_t *proc) {
+    proc_table_remove(proc);
+    pid_release(proc->pid);
+}
+
+/* remove a process from the process table, release its pid and free it */
+static void process_free(process_t *proc) {
+    process_unlink(proc);
+    free(proc);
 }
 
 int get_processes(sos_process_t *processes, int max) {
     if (max <= 0) return 0;
     int count = 0;
-    for (int i = 0; i < MAX_PROCS; ++i) {
-        if (runprocs[i].state != PROC_FREE && runprocs[i].state != PROC_CREATING) {
-            processes->pid = runprocs[i].pid;
-            processes->size = runprocs[i].addrspace->pagecount;
-            processes->stime = runprocs[i].stime / 1000; // time in msec
-            strncpy(processes->command, runprocs[i].command, N_NAME);
+    for (process_t *curr = proc_live; curr != NULL; curr = curr->live_next) {
+        if (curr->state != PROC_FREE && curr->state != PROC_CREATING) {
+            processes->pid = curr->pid;
+            processes->size = curr->addrspace->pagecount;
+            processes->stime = curr->stime / 1000; // time in msec
+            strncpy(processes->command, curr->command, N_NAME);
             processes->command[N_NAME - 1] = '\0';
             if (++count == max) break;
             ++processes;
@@ -235,6 +357,23 @@ struct sfp_args {
 
 static void _delete_process(process_t *proc, coro_t coro);
 
+/* Share the timer's register page read-only, so the process can read the
+ * timestamp without a syscall (sos_time_now) */
+static seL4_Error map_timer_page(cspace_t *cspace, process_t *proc, coro_t coro) {
+    seL4_Error err = as_define_region(proc->addrspace, PROCESS_TIMER_PAGE, PAGE_SIZE_4K, seL4_CanRead,
+                                      seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, NULL);
+    if (err) return err;
+    return sos_clone_and_map_device_frame(proc->addrspace, cspace, timer_cptr, PROCESS_TIMER_PAGE, seL4_CanRead,
+                                          seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, coro);
+}
+
+/* tear down a half-created process and fail start_process */
+static pid_t _abort_process(process_t *proc, coro_t coro) {
+    _delete_process(proc, coro);
+    process_free(proc);
+    return -1;
+}
+
 /* Start process, and return pid if successful
  */
 pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, bool pinned, coro_t coro) {
@@ -248,45 +387,39 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         return -1;
     }
 
-    pid_t pid = get_next_pid();
-    if (pid == -1) return -1;
-
-    process_t *proc = runprocs + (pid % MAX_PROCS);
-    proc->pid = pid;
-    proc->kill_hook = NULL;
-    proc->state = PROC_CREATING;
+    process_t *proc = process_alloc();
+    if (proc == NULL) {
+        ZF_LOGE("can't allocate process");
+        return -1;
+    }
 
     /* Create a VSpace */
     proc->vspace_ut = alloc_retype(&(proc->vspace), seL4_ARM_PageGlobalDirectoryObject,
                                               seL4_PGDBits);
     if (proc->vspace_ut == NULL) {
         ZF_LOGE("failed to alloc vspace_ut");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* assign the vspace to an asid pool */
     seL4_Word err = seL4_ARM_ASIDPool_Assign(seL4_CapInitThreadASIDPool, proc->vspace);
     if (err != seL4_NoError) {
         ZF_LOGE("Failed to assign asid pool");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create a simple 1 level CSpace */
     err = cspace_create_one_level(cspace, &(proc->cspace));
     if (err != CSPACE_NOERROR) {
         ZF_LOGE("Failed to create cspace");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create an as */
     proc->addrspace = as_create(proc->vspace, coro);
     if (proc->addrspace == NULL) {
         ZF_LOGE("Failed to create addrspace");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create an IPC buffer */
@@ -294,8 +427,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
                 seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, NULL);
     if (err) {
         ZF_LOGE("Failed to define IPC region");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create an IPC frame */
@@ -304,8 +436,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
                                         seL4_AllRights, seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, &ipc_buffer, coro, pinned);
     if (err) {
         ZF_LOGE("Failed to alloc map IPC frame");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* allocate a new slot in the target cspace which we will mint a badged endpoint cap into --
@@ -314,24 +445,21 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     seL4_CPtr user_ep = cspace_alloc_slot(&(proc->cspace));
     if (user_ep == seL4_CapNull) {
         ZF_LOGE("Failed to alloc user ep slot");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* now mutate the cap, thereby setting the badge */
     err = cspace_mint(&(proc->cspace), user_ep, cspace, ipc_ep, seL4_AllRights, PID_TO_BADGE(proc->pid));
     if (err) {
         ZF_LOGE("Failed to mint user ep");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create a new TCB object */
     proc->tcb_ut = alloc_retype(&(proc->tcb), seL4_TCBObject, seL4_TCBBits);
     if (proc->tcb_ut == NULL) {
         ZF_LOGE("Failed to alloc tcb ut");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Configure the TCB */
@@ -341,8 +469,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
                              ipc_buffer.cap);
     if (err != seL4_NoError) {
         ZF_LOGE("Unable to configure new TCB");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Create scheduling context */
@@ -350,16 +477,14 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
                                                      seL4_MinSchedContextBits);
     if (proc->sched_context_ut == NULL) {
         ZF_LOGE("Failed to alloc sched context ut");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Configure the scheduling context to use the first core with budget equal to period */
     err = seL4_SchedControl_Configure(sched_ctrl_start, proc->sched_context, US_IN_MS, US_IN_MS, 0, 0);
     if (err != seL4_NoError) {
         ZF_LOGE("Unable to configure scheduling context");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* allocate a new slot in the kernel cspace which we will mint a badged endpoint cap into --
@@ -368,16 +493,14 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     proc->kernel_ep = cspace_alloc_slot(cspace);
     if (proc->kernel_ep == seL4_CapNull) {
         ZF_LOGE("Failed to alloc kernel ep slot");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* now mutate the cap, thereby setting the badge */
     err = cspace_mint(cspace, proc->kernel_ep, cspace, ipc_ep, seL4_AllRights, PID_TO_BADGE(proc->pid));
     if (err) {
         ZF_LOGE("Failed to mint user ep");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* bind sched context, set fault endpoint and priority
@@ -388,8 +511,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
                                   proc->sched_context, proc->kernel_ep);
     if (err != seL4_NoError) {
         ZF_LOGE("Unable to set scheduling params");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* Provide a name for the thread -- Helpful for debugging */
@@ -402,8 +524,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     err = vfs_open(app_name, O_RDONLY, &elf_vnode, coro);
     if (err) {
         ZF_LOGE("can't open file");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* load in header (56/64 bytes) */
@@ -411,8 +532,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     if (headerframe == NULL_FRAME) {
         ZF_LOGE("can't allocate frame");
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
     pin_frame(headerframe);
     void *headerbytes = frame_data(headerframe);
@@ -423,8 +543,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         unpin_frame(headerframe);
         free_frame(headerframe);
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
     int headersize = VOP_READ(elf_vnode, &myuio, proc, coro);
     if (headersize < 0) {
@@ -432,8 +551,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         unpin_frame(headerframe);
         free_frame(headerframe);
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
     uio_destroy(&myuio, NULL);
 
@@ -451,8 +569,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         unpin_frame(headerframe);
         free_frame(headerframe);
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     /* set up the stack */
@@ -462,8 +579,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         unpin_frame(headerframe);
         free_frame(headerframe);
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     vaddr_t heap_start;
@@ -475,8 +591,7 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
         unpin_frame(headerframe);
         free_frame(headerframe);
         vfs_close(elf_vnode, coro);
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
     uintptr_t entrypoint = elf_getEntryPoint(&elf_file);
 
@@ -488,18 +603,22 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     err = as_define_heap(proc->addrspace, heap_start);
     if (err) {
         ZF_LOGE("Failed to define heap region");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
 
     fdtable_init(&proc->fdt, coro);
 
+    err = map_timer_page(cspace, proc, coro);
+    if (err) {
+        ZF_LOGE("Failed to map timer page");
+        return _abort_process(proc, coro);
+    }
+
     if (hook) {
         err = hook(proc, coro);
         if (err != 0) {
             ZF_LOGE("Failed in proc create hook");
-            _delete_process(proc, coro);
-            return -1;
+            return _abort_process(proc, coro);
         }
     }
 
@@ -520,12 +639,12 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
     if (err != seL4_NoError) {
         // free everything
         ZF_LOGE("Failed to write registers");
-        _delete_process(proc, coro);
-        return -1;
+        return _abort_process(proc, coro);
     }
     return proc->pid;
 }
 
+#ifndef CONFIG_SOS_INTERNAL_TIMER
 seL4_Error clock_hook(process_t *proc, coro_t coro) {
     seL4_Error err = as_define_region(proc->addrspace, CLOCK_DRIVER_ADDR, PAGE_SIZE_4K, seL4_AllRights,
                 seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, NULL);
@@ -539,7 +658,10 @@ seL4_Error clock_hook(process_t *proc, coro_t coro) {
     if (reply_obj == seL4_CapNull) return seL4_NotEnoughMemory;
     err = cspace_untyped_retype(&(proc->cspace), reply_ut->cap, reply_obj, seL4_ReplyObject, seL4_ReplyBits);
     if (err) return err;
-    return sos_clone_and_map_device_frame(proc->addrspace, &cspace, timer_cptr, CLOCK_DRIVER_ADDR, coro);
+    err = timer_ring_map(&cspace, proc, coro);
+    if (err) return err;
+    return sos_clone_and_map_device_frame(proc->addrspace, &cspace, timer_cptr, CLOCK_DRIVER_ADDR, seL4_AllRights, 0,
+                                          coro);
 }
 
 static void start_clock_driver(cspace_t *cspace, coro_t coro) {
@@ -547,6 +669,11 @@ static void start_clock_driver(cspace_t *cspace, coro_t coro) {
         ZF_LOGE("Failed to start clock_driver");
     }
 }
+#else
+static void start_clock_driver(UNUSED cspace_t *cspace, UNUSED coro_t coro) {
+    /* the timer service runs inside SOS */
+}
+#endif
 
 void *_start_first_process_impl(void *args) {
     struct sfp_args *sargs = args;
@@ -561,6 +688,7 @@ bool start_first_process(cspace_t *cspace, char *app_name, seL4_CPtr _ipc_ep, se
     ipc_ep = _ipc_ep;
     timer_ep = _timer_ep;
     coro_t c = coroutine(_start_first_process_impl);
+    if (c == NULL) return false;
     struct sfp_args args = {
         .cspace = cspace,
         .app_name = app_name,
@@ -599,10 +727,10 @@ pid_t wait_for_process_exit(pid_t pid, process_t *me, coro_t coro) {
     if (pid == -1) {
         queue = &global_exit_blocked;
     } else {
-        int bucket = pid % MAX_PROCS;
-        if (oldpids[bucket] == pid) return pid;
-        if (runprocs[bucket].pid != pid) return -1;
-        queue = &(runprocs[bucket].exit_blocked);
+        if (pid > 0 && pid <= MAX_PID && bf_get_bit(pid_exited, pid)) return pid;
+        process_t *proc = get_process_by_pid(pid);
+        if (proc == NULL) return -1;
+        queue = &(proc->exit_blocked);
     }
     runqueue_t *rq = malloc(sizeof(runqueue_t));
     if (rq == NULL) return -1;
@@ -619,14 +747,15 @@ pid_t wait_for_process_exit(pid_t pid, process_t *me, coro_t coro) {
 static void _delete_process(process_t *proc, coro_t coro) {
     ZF_LOGD("deleting proc %d", proc->pid);
 
-    rid_remove_id(&proc_rid, proc->pid);
-
     bool restart_clock = false;
     if (proc->pid == clock_driver_pid) {
         clock_driver_pid = -1;
         restart_clock = true;
     }
 
+    /* ring ops still use the fds and the address space */
+    ring_destroy(proc, coro);
+
     // this is safe to call if everything is null
     fdtable_destroy(&(proc->fdt), coro);
 
@@ -662,20 +791,66 @@ static void _delete_process(process_t *proc, coro_t coro) {
     proc->state = PROC_FREE;
 }
 
+struct reap_args {
+    process_t *proc;
+    bool restart_clock;
+    coro_t coro;
+};
+
+/* background job tearing down the resources of a dead process */
+static void *_reap_process(void *data) {
+    struct reap_args *args = data;
+    process_t *proc = args->proc;
+    bool restart_clock = args->restart_clock;
+    coro_t coro = args->coro;
+    free(args);
+
+    ZF_LOGD("reaping proc %d", proc->pid);
+    _delete_process(proc, coro);
+    free(proc);
+
+    if (restart_clock) start_clock_driver(&cspace, coro);
+    return NULL;
+}
+
+/* Kill a process. It stops running and its pid can be reused as soon as
+ * this returns; its fds, address space and caps are torn down later by a
+ * background coroutine that yields between slices of work. */
 void kill_process(process_t *proc, coro_t coro) {
     ZF_LOGD("killing proc %d", proc->pid);
     seL4_TCB_Suspend(proc->tcb);
 
-    _delete_process(proc, coro);
-
     pid_t pid = proc->pid;
-    oldpids[pid % MAX_PROCS] = pid;
+    bool restart_clock = false;
+    if (pid == clock_driver_pid) {
+        clock_driver_pid = -1;
+        restart_clock = true;
+    }
 
     // this should fix weird race conditions
     runqueue_t *proc_exit_blocked = proc->exit_blocked;
     runqueue_t *lglobal_exit_blocked = global_exit_blocked;
     global_exit_blocked = NULL;
-    memset(proc, 0, sizeof(process_t));
+    proc->exit_blocked = NULL;
+    proc->state = PROC_FREE;
+    process_unlink(proc);
+    bf_set_bit(pid_exited, pid);
+
+    struct reap_args *args = malloc(sizeof(struct reap_args));
+    coro_t reaper = args ? coroutine(_reap_process) : NULL;
+    if (reaper == NULL) {
+        /* no memory for a background job, tear it down right here */
+        free(args);
+        _delete_process(proc, coro);
+        free(proc);
+        if (restart_clock) start_clock_driver(&cspace, coro);
+    } else {
+        args->proc = proc;
+        args->restart_clock = restart_clock;
+        args->coro = reaper;
+        set_coro_prio(reaper, SCHED_BACKGROUND);
+        sched_wake(reaper, args);
+    }
 
     exhaust_runqueue(&lglobal_exit_blocked, pid);
     exhaust_runqueue(&proc_exit_blocked, pid);
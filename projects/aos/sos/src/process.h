@@ -13,13 +13,15 @@
 #define TTY_PRIORITY         (0)
 #define TTY_EP_BADGE         (101)
 
-/* max num of simultaneously-running processes
- * this can't be too large since we'll run out of sos stack space for coroutine. Increase stack space if you want to increase this. */
-#define MAX_PROCS 20
 /* max possible PID value.
-   once we reach max, we start filling from 1 again (with a simple non-collision hashtable) */
+   once we reach max, freed pids are recycled in the order they were released */
 #define MAX_PID 65535
 
+/* initial number of buckets in the pid -> process hash table (must be a power of 2) */
+#define PROC_HASH_INIT_BUCKETS 64
+/* grow the hash table once the average chain length goes above this */
+#define PROC_HASH_MAX_LOAD     2
+
 #define N_NAME 32
 
 #define PROC_FREE         0
@@ -71,14 +73,17 @@ struct process {
     void (*kill_hook)(void *data); /* hook function to run before killing this process */
     void *kill_hook_data;          /* data to pass into kill_hook function */
 
-    coro_t paging_coro;            /* if blocked by nfs paging, the paging coroutine */
+    struct ring *ring;             /* asynchronous syscall ring, NULL until set up */
+    struct process *kill_next;     /* next process waiting in retry_fault_kills */
+
+    struct process *hash_next;     /* next process in the same pid hash bucket */
+    struct process *live_prev;     /* previous process in the live process list */
+    struct process *live_next;     /* next process in the live process list */
 };
 
 typedef seL4_Error (*proc_create_hook)(struct process *proc, coro_t coro);
 
 extern process_t *currproc;
-extern process_t oldprocs[];
-extern process_t runprocs[];
 
 /* The linker will link this symbol to the start address  *
  * of an archive of attached applications.                */
@@ -91,7 +96,7 @@ seL4_CPtr sched_ctrl_end;
 
 void process_init();
 
-unsigned get_time();
+uint64_t get_time();
 bool is_clock_driver_ready();
 
 void kill_process(process_t *proc, coro_t coro);
@@ -102,3 +107,5 @@ pid_t start_process(cspace_t *cspace, char *app_name, proc_create_hook hook, boo
 
 
 process_t *get_process_by_pid(pid_t pid);
+int get_processes(sos_process_t *processes, int max);
+size_t process_count();
@@ -23,8 +23,11 @@
  *
  * This is rather terrible, but is the simplest option without a
  * huge amount of infrastructure.
+ *
+ * Process descriptors are heap allocated, so this has to be big enough
+ * for a few thousand of them on top of everything else.
  */
-#define MORECORE_AREA_BYTE_SIZE 0x100000
+#define MORECORE_AREA_BYTE_SIZE 0x1000000
 char morecore_area[MORECORE_AREA_BYTE_SIZE];
 
 /* Pointer to free space in the morecore area. */
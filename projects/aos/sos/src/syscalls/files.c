@@ -9,27 +9,14 @@
 
 #include "../vfs/vfs.h"
 #include "../vfs/uio.h"
+#include <utils/util.h>
 
 extern void *timer_vaddr;
 extern seL4_CPtr timer_cptr;
 
-IMPLEMENT_SYSCALL(open, 3) {
-    char pathname[PATH_MAX + 1];
-
-    vaddr_t pathname_ptr = seL4_GetMR(1);
-    int pathlen = seL4_GetMR(2);
-    if (pathlen > PATH_MAX) {
-        return return_word(-ENAMETOOLONG);
-    }
-    int flags = seL4_GetMR(3);
-
-    int err = copy_in(cspace, proc->addrspace, proc, pathname_ptr, pathlen, pathname, me);
-    //int err = copy_in(cspace, proc->vspace, proc->addrspace, pathname_ptr, pathlen, pathname);
-    if (err) return return_word(-EINVAL);
-    pathname[pathlen] = '\0';
-
+int file_open(process_t *proc, char *pathname, int flags, coro_t me) {
     if ((flags & (O_RDONLY | O_WRONLY | O_RDWR | O_CREAT | O_EXCL | O_TRUNC | O_APPEND)) != flags) {
-        return return_word(-EINVAL);
+        return -EINVAL;
     }
 
     // always create non-existent files (stupid requirement)
@@ -37,13 +24,13 @@ IMPLEMENT_SYSCALL(open, 3) {
 
     int accmode = flags & O_ACCMODE;
     if (accmode != O_RDONLY && accmode != O_WRONLY && accmode != O_RDWR) {
-        return return_word(-EINVAL);
+        return -EINVAL;
     }
 
     struct fdesc* fdesc_node = NULL;
-    err = fdesc_open(pathname, flags, 0000, &fdesc_node, me);
+    int err = fdesc_open(pathname, flags, 0000, &fdesc_node, me);
     if (err) {
-        return return_word(err);
+        return err;
     }
 
     int fd = fdtable_append(&proc->fdt, fdesc_node, me);
@@ -51,35 +38,58 @@ IMPLEMENT_SYSCALL(open, 3) {
         fdesc_destroy(fdesc_node, me);
     }
 
-    return return_word(fd);
+    return fd;
 }
 
-IMPLEMENT_SYSCALL(close, 1) {
-    int fd = seL4_GetMR(1);
+int file_close(process_t *proc, int fd, coro_t me) {
     struct fdesc* fdesc_node = NULL;
     int err = fdtable_get(&proc->fdt, fd, &fdesc_node, me);
-    if (err) return return_word(err);
+    if (err) return err;
     proc->fdt.fds[fd] = NULL;
     fdesc_decrement(fdesc_node, me);
-    return return_word(0);
+    return 0;
 }
 
-static inline seL4_MessageInfo_t read_write(SYSCALL_PARAMS, int is_write) {
+/* a NULL path pointer means the path follows the arguments inline */
+IMPLEMENT_SYSCALL_PAYLOAD(open, 3) {
+    char pathname[PATH_MAX + 1];
+    vaddr_t pathname_ptr = seL4_GetMR(1);
+    size_t pathlen = seL4_GetMR(2);
+    int flags = seL4_GetMR(3);
+    int err = get_pathname(cspace, proc, pathname_ptr, pathlen, 4, nargs, pathname, me);
+    if (err) return return_word(err);
+    return return_word(file_open(proc, pathname, flags, me));
+}
+
+IMPLEMENT_SYSCALL(close, 1) {
     int fd = seL4_GetMR(1);
-    vaddr_t vaddr = seL4_GetMR(2);
-    size_t size = seL4_GetMR(3);
+    return return_word(file_close(proc, fd, me));
+}
 
+/* Look up fd for reading or writing and take a reference on it, as the fd
+ * may be closed by a ring operation while we are blocked. */
+static int file_get(process_t *proc, int fd, bool is_write, fdesc_t **result, coro_t me) {
     fdesc_t *fdesc_node = NULL;
-    int err;
-    err = fdtable_get(&proc->fdt, fd, &fdesc_node, me);
-    if (err) return return_word(err);
+    int err = fdtable_get(&proc->fdt, fd, &fdesc_node, me);
+    if (err) return err;
 
     if ((!is_write) && (fdesc_node->flag & O_ACCMODE) == O_WRONLY)
-        return return_word(-EBADF);
+        return -EBADF;
     if (is_write && (fdesc_node->flag & O_ACCMODE) == O_RDONLY)
-        return return_word(-EBADF);
+        return -EBADF;
+
+    fdesc_increment(fdesc_node, me);
+    *result = fdesc_node;
+    return 0;
+}
 
+/* Transfer straight between the user buffer and the file, a page at a time */
+static long fdesc_read_write(cspace_t *cspace, process_t *proc, fdesc_t *fdesc_node, vaddr_t vaddr, size_t size,
+                             bool is_write, bool killable, coro_t me) {
     size_t remaining = size;
+    long ret = 0;
+    user_cursor_t uc;
+    user_cursor_init(&uc, cspace, proc->addrspace, proc, !is_write);
 
     bool cont = true;
 
@@ -88,33 +98,211 @@ static inline seL4_MessageInfo_t read_write(SYSCALL_PARAMS, int is_write) {
         size_t rem = remaining < PAGE_SIZE_4K ? remaining : PAGE_SIZE_4K;
         int nb;
         if (is_write) {
-            if (uio_uinit(&myuio, vaddr, rem, 0, UIO_READ, cspace, proc, proc->addrspace, me)) return return_word(-1);
+            if (uio_uinit(&myuio, &uc, vaddr, rem, 0, UIO_READ, me)) {
+                ret = -1;
+                break;
+            }
             if (myuio.iovec.len < rem) rem = myuio.iovec.len;
             nb = VOP_WRITE(fdesc_node->vnode, &myuio, me);
         } else {
-            if (uio_uinit(&myuio, vaddr, rem, 0, UIO_WRITE, cspace, proc, proc->addrspace, me)) return return_word(-1);
+            if (uio_uinit(&myuio, &uc, vaddr, rem, 0, UIO_WRITE, me)) {
+                ret = -1;
+                break;
+            }
             if (myuio.iovec.len < rem) rem = myuio.iovec.len;
-            nb = VOP_READ(fdesc_node->vnode, &myuio, proc, me);
+            nb = VOP_READ(fdesc_node->vnode, &myuio, killable ? proc : NULL, me);
             if (nb != rem) cont = false;
         }
         
         uio_destroy(&myuio, cspace);
-        if (nb < 0) return return_word(nb);
+        if (nb < 0) {
+            ret = nb;
+            break;
+        }
         remaining -= nb;
         ZF_LOGD("read %d bytes from %p, remaining %d", nb, vaddr, remaining);
         // uio_destroy doesn't change those
         vaddr += nb;
     }
 
-    return return_word(size - remaining);
+    if (ret < 0) return ret;
+    return size - remaining;
+}
+
+long file_read_write(cspace_t *cspace, process_t *proc, int fd, vaddr_t vaddr, size_t size, bool is_write,
+                     bool killable, coro_t me) {
+    fdesc_t *fdesc_node = NULL;
+    int err = file_get(proc, fd, is_write, &fdesc_node, me);
+    if (err) return err;
+    long ret = fdesc_read_write(cspace, proc, fdesc_node, vaddr, size, is_write, killable, me);
+    fdesc_decrement(fdesc_node, me);
+    return ret;
+}
+
+/*
+ * Vectored I/O.
+ *
+ * Small iovecs are gathered into (or scattered from) a one page bounce
+ * buffer, so e.g. the two element iovecs musl's stdio flushes with become
+ * a single VOP, and a single NFS RPC. Iovecs that don't fit in what is
+ * left of the bounce buffer go straight to fdesc_read_write.
+ */
+
+/* layout of struct iovec on the user side */
+typedef struct {
+    vaddr_t base;
+    size_t len;
+} user_iovec_t;
+
+typedef struct {
+    cspace_t *cspace;
+    process_t *proc;
+    fdesc_t *fdesc;
+    bool is_write;
+    bool killable;
+    coro_t me;
+    char *buf;
+    size_t fill;
+    /* for reads, where each chunk of buf goes */
+    user_iovec_t pending[FILE_IOV_BATCH];
+    size_t npending;
+} iov_bounce_t;
+
+/* Run one VOP over the bounce buffer. Returns the bytes moved, or < 0. */
+static long iov_bounce_flush(iov_bounce_t *b) {
+    if (b->fill == 0) return 0;
+    uio_t myuio;
+    long nb;
+    if (b->is_write) {
+        uio_kinit(&myuio, b->buf, b->fill, 0, UIO_READ);
+        nb = VOP_WRITE(b->fdesc->vnode, &myuio, b->me);
+    } else {
+        uio_kinit(&myuio, b->buf, b->fill, 0, UIO_WRITE);
+        nb = VOP_READ(b->fdesc->vnode, &myuio, b->killable ? b->proc : NULL, b->me);
+        size_t off = 0;
+        for (size_t i = 0; i < b->npending && nb > 0 && off < (size_t) nb; i++) {
+            size_t len = MIN(b->pending[i].len, nb - off);
+            if (copy_out(b->cspace, b->proc->addrspace, b->proc, b->pending[i].base, len, b->buf + off, b->me)) {
+                nb = -EFAULT;
+                break;
+            }
+            off += len;
+        }
+    }
+    b->npending = 0;
+    return nb;
+}
+
+long file_read_write_vec(cspace_t *cspace, process_t *proc, int fd, vaddr_t iov_ptr, int iovcnt, bool is_write,
+                         bool killable, coro_t me) {
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) return -EINVAL;
+
+    iov_bounce_t b = {
+        .cspace = cspace,
+        .proc = proc,
+        .is_write = is_write,
+        .killable = killable,
+        .me = me,
+    };
+    int err = file_get(proc, fd, is_write, &b.fdesc, me);
+    if (err) return err;
+    b.buf = malloc(PAGE_SIZE_4K);
+    if (b.buf == NULL) {
+        fdesc_decrement(b.fdesc, me);
+        return -ENOMEM;
+    }
+
+    user_iovec_t iov[FILE_IOV_BATCH];
+    long done = 0;
+    long ret = 0;
+    bool stop = false;
+
+    for (int i = 0; i < iovcnt && !stop && proc->state != PROC_TO_BE_KILLED; i += FILE_IOV_BATCH) {
+        int n = MIN(FILE_IOV_BATCH, iovcnt - i);
+        if (copy_in(cspace, proc->addrspace, proc, iov_ptr + i * sizeof(user_iovec_t), n * sizeof(user_iovec_t),
+                    iov, me)) {
+            ret = -EFAULT;
+            break;
+        }
+
+        for (int j = 0; j < n && !stop; j++) {
+            if (iov[j].len == 0) continue;
+
+            if (iov[j].len > PAGE_SIZE_4K - b.fill || b.npending == FILE_IOV_BATCH) {
+                /* no room left, push out what we gathered so far */
+                size_t want = b.fill;
+                ret = iov_bounce_flush(&b);
+                b.fill = 0;
+                if (ret < 0) break;
+                done += ret;
+                if ((size_t) ret < want) {
+                    stop = true;
+                    break;
+                }
+            }
+
+            if (iov[j].len <= PAGE_SIZE_4K - b.fill) {
+                if (is_write) {
+                    if (copy_in(cspace, proc->addrspace, proc, iov[j].base, iov[j].len, b.buf + b.fill, me)) {
+                        ret = -EFAULT;
+                        break;
+                    }
+                } else {
+                    b.pending[b.npending++] = iov[j];
+                }
+                b.fill += iov[j].len;
+            } else {
+                ret = fdesc_read_write(cspace, proc, b.fdesc, iov[j].base, iov[j].len, is_write, killable, me);
+                if (ret < 0) break;
+                done += ret;
+                if ((size_t) ret < iov[j].len) stop = true;
+            }
+        }
+        if (ret < 0) break;
+    }
+
+    if (ret >= 0 && !stop) {
+        ret = iov_bounce_flush(&b);
+        if (ret > 0) done += ret;
+    }
+
+    free(b.buf);
+    fdesc_decrement(b.fdesc, me);
+    /* like read/write, an error after some progress is a short transfer */
+    if (ret < 0 && done == 0) return ret;
+    return done;
+}
+
+static inline seL4_MessageInfo_t read_write(SYSCALL_PARAMS, int is_write) {
+    (void) nargs;
+    int fd = seL4_GetMR(1);
+    vaddr_t vaddr = seL4_GetMR(2);
+    size_t size = seL4_GetMR(3);
+    return return_word(file_read_write(cspace, proc, fd, vaddr, size, is_write, true, me));
 }
 
 IMPLEMENT_SYSCALL(read, 3) {
-    return read_write(cspace, proc, me, 0);
+    return read_write(cspace, proc, nargs, me, 0);
 }
 
 IMPLEMENT_SYSCALL(write, 3) {
-    return read_write(cspace, proc, me, 1);
+    return read_write(cspace, proc, nargs, me, 1);
+}
+
+static inline seL4_MessageInfo_t read_write_vec(SYSCALL_PARAMS, int is_write) {
+    (void) nargs;
+    int fd = seL4_GetMR(1);
+    vaddr_t iov_ptr = seL4_GetMR(2);
+    int iovcnt = seL4_GetMR(3);
+    return return_word(file_read_write_vec(cspace, proc, fd, iov_ptr, iovcnt, is_write, true, me));
+}
+
+IMPLEMENT_SYSCALL(readv, 3) {
+    return read_write_vec(cspace, proc, nargs, me, 0);
+}
+
+IMPLEMENT_SYSCALL(writev, 3) {
+    return read_write_vec(cspace, proc, nargs, me, 1);
 }
 
 IMPLEMENT_SYSCALL(getdirent, 3) {
@@ -131,21 +319,21 @@ IMPLEMENT_SYSCALL(getdirent, 3) {
     return return_word(ret);
 }
 
-IMPLEMENT_SYSCALL(stat, 3) {
+/* a NULL path pointer means the path follows the arguments inline,
+ * a NULL stat pointer that the stat goes back inline after the result */
+IMPLEMENT_SYSCALL_PAYLOAD(stat, 3) {
     char pathname[PATH_MAX + 1];
 
     vaddr_t pathname_ptr = seL4_GetMR(1);
-    int pathlen = seL4_GetMR(2);
+    size_t pathlen = seL4_GetMR(2);
     vaddr_t stat_ptr = seL4_GetMR(3);
-    if (pathlen > PATH_MAX) {
-        return return_word(-ENAMETOOLONG);
-    }
-    int err = copy_in(cspace, proc->addrspace, proc, pathname_ptr, pathlen, pathname, me);
-    if (err) return return_word(-EINVAL);
-    pathname[pathlen] = '\0';
+    int err = get_pathname(cspace, proc, pathname_ptr, pathlen, 4, nargs, pathname, me);
+    if (err) return return_word(err);
     sos_stat_t stat;
     int ret = vfs_stat(pathname, &stat, me);
-    if (ret == 0) {
+    if (ret == 0 && stat_ptr == 0) {
+        return return_payload(ret, &stat, sizeof(sos_stat_t));
+    } else if (ret == 0) {
         if(copy_out(cspace, proc->addrspace, proc, (vaddr_t) stat_ptr, sizeof(sos_stat_t), &stat, me) != 0)
             ret = -EINVAL;
     }
@@ -9,3 +9,18 @@ DEFINE_SYSCALL(read);
 DEFINE_SYSCALL(write);
 DEFINE_SYSCALL(getdirent);
 DEFINE_SYSCALL(stat);
+DEFINE_SYSCALL(readv);
+DEFINE_SYSCALL(writev);
+
+/* iovecs copied in from the user at a time by readv/writev */
+#define FILE_IOV_BATCH 32
+
+/* Syscall bodies, shared with the syscall ring. They return the value the
+ * syscall would reply with. killable lets a blocking read install proc's
+ * kill hook, which only the syscall itself may do. */
+int file_open(process_t *proc, char *pathname, int flags, coro_t me);
+int file_close(process_t *proc, int fd, coro_t me);
+long file_read_write(cspace_t *cspace, process_t *proc, int fd, vaddr_t vaddr, size_t size, bool is_write,
+                     bool killable, coro_t me);
+long file_read_write_vec(cspace_t *cspace, process_t *proc, int fd, vaddr_t iov_ptr, int iovcnt, bool is_write,
+                         bool killable, coro_t me);
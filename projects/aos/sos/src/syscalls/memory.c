@@ -7,6 +7,8 @@
 #include "syscall.h"
 #include "memory.h"
 
+#include "../vmem_layout.h"
+
 #include "../coroutine/picoro.h"
 
 static inline seL4_CapRights_t get_sel4_rights_from_prot(int prot)
@@ -28,24 +30,27 @@ IMPLEMENT_SYSCALL(brk, 1) {
     // NOTES: this is different from the actual Linux syscall: we require brk to align
     // this is for simplicity reasons
     if (IS_ALIGNED_4K(vaddr) && heap->vbase <= vaddr && vaddr <= heap->next->vbase) {
-        for (vaddr_t curr = IS_ALIGNED_4K(vaddr) ? vaddr : PAGE_ALIGN_4K(vaddr) + 1; curr < heap->vbase + heap->memsize; curr += PAGE_SIZE_4K) {
-            unalloc_frame(proc->addrspace, cspace, curr, me);
-        }
+        /* shrinking frees frames, which may have to wait for a page out */
+        if (me == NULL && vaddr < heap->vbase + heap->memsize) return retry_in_coroutine();
+        unalloc_range(proc->addrspace, cspace, vaddr, heap->vbase + heap->memsize, me);
         heap->memsize = vaddr - heap->vbase;
+        as_region_resized(proc->addrspace, heap);
     }
 
     return return_word(heap->vbase + heap->memsize);
 }
 
-IMPLEMENT_SYSCALL(mmap, 3) {
+IMPLEMENT_SYSCALL(mmap, 4) {
     vaddr_t vaddr = seL4_GetMR(1);
-    /* if mmap is called with NULL, we append the mmap region to the end of addrspace */
+    size_t memsize = seL4_GetMR(2);
+    int flags = seL4_GetMR(4);
+    /* prefaulting allocates frames, which may have to wait for a page out */
+    if (me == NULL && (flags & MAP_POPULATE)) return retry_in_coroutine();
+    /* if mmap is called with NULL, we take the first hole above the stack that fits */
     if (vaddr == NULL) {
-        region_t *curr = proc->addrspace->regions;
-        while (curr->next != NULL) curr = curr->next;
-        vaddr = VEND(curr);
+        vaddr = as_find_free(proc->addrspace, PROCESS_MMAP_BASE, PROCESS_MMAP_TOP, memsize);
+        if (vaddr == NULL) return return_word(NULL);
     }
-    size_t memsize = seL4_GetMR(2);
     int prot = seL4_GetMR(3);
     seL4_ARM_VMAttributes attr = seL4_ARM_Default_VMAttributes;
     if (!(prot & PROT_EXEC)) attr |= seL4_ARM_ExecuteNever;
@@ -54,6 +59,8 @@ IMPLEMENT_SYSCALL(mmap, 3) {
     int result = as_define_region(proc->addrspace, vaddr, memsize, rights, attr, &r);
     if (result != 0) return return_word(NULL);
     r->mmaped = true;
+    /* like Linux, failing to prefault doesn't fail the mmap */
+    if (flags & MAP_POPULATE) prefault_range(cspace, proc->addrspace, proc, vaddr, vaddr + memsize, true, me);
     /*printf("mmap region list: ");
     region_t *region = proc->addrspace->regions;
     while (region != NULL) {
@@ -71,7 +78,7 @@ IMPLEMENT_SYSCALL(munmap, 2) {
     if (length == 0) return return_word(0);
     vaddr_t munmap_end = munmap_start + length;
     if (!(IS_ALIGNED_4K(munmap_start) && IS_ALIGNED_4K(munmap_end))) return return_word(-EINVAL);
-    region_t *region = get_region(proc->addrspace->regions, munmap_start);
+    region_t *region = get_region(proc->addrspace, munmap_start);
     if (region == NULL || !(region->mmaped)) return return_word(-EINVAL);
     region_t *curr = region;
     /* check if we munmap valid address */
@@ -125,9 +132,7 @@ IMPLEMENT_SYSCALL(munmap, 2) {
         }*/
     }
     /* unallocate frames of munmap region */
-    for (vaddr_t start = munmap_start; start < munmap_end; start += PAGE_SIZE_4K) {
-        unalloc_frame(proc->addrspace, cspace, start, me);
-    }
+    unalloc_range(proc->addrspace, cspace, munmap_start, munmap_end, me);
 
     /*printf("munmap region list: ");
     region = proc->addrspace->regions;
@@ -138,3 +143,47 @@ IMPLEMENT_SYSCALL(munmap, 2) {
     printf("\n");*/
     return return_word(0);
 }
+
+/*
+ * 0 if every byte of [start, end) is in some region, -ENOMEM otherwise.
+ * With mmaped set all of those regions must come from mmap, or -EINVAL.
+ */
+static int check_range(addrspace_t *as, vaddr_t start, vaddr_t end, bool mmaped) {
+    region_t *r = get_region(as, start);
+    if (r == NULL) return -ENOMEM;
+    while (true) {
+        if (mmaped && !r->mmaped) return -EINVAL;
+        if (VEND(r) >= end) return 0;
+        if (r->next == NULL || r->next->vbase != VEND(r)) return -ENOMEM;
+        r = r->next;
+    }
+}
+
+IMPLEMENT_SYSCALL(madvise, 3) {
+    vaddr_t start = seL4_GetMR(1);
+    size_t length = seL4_GetMR(2);
+    int advice = seL4_GetMR(3);
+    vaddr_t end = start + ROUND_UP(length, PAGE_SIZE_4K);
+    if (!IS_ALIGNED_4K(start) || end < start) return return_word(-EINVAL);
+    if (length == 0) return return_word(0);
+    /* like munmap, only mmaped memory can be thrown away */
+    int err = check_range(proc->addrspace, start, end, advice == MADV_DONTNEED);
+    if (err) return return_word(err);
+
+    switch (advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+        /* no readahead to tune */
+        return return_word(0);
+    case MADV_WILLNEED:
+        /* bring back what was paged out, without allocating anything new */
+        return return_word(prefault_range(cspace, proc->addrspace, proc, start, end, false, me));
+    case MADV_DONTNEED:
+        /* frames and pagefile slots go now, the pages read as new next time */
+        discard_range(proc->addrspace, cspace, start, end, me);
+        return return_word(0);
+    default:
+        return return_word(-EINVAL);
+    }
+}
@@ -6,3 +6,4 @@
 DEFINE_SYSCALL(brk);
 DEFINE_SYSCALL(mmap);
 DEFINE_SYSCALL(munmap);
+DEFINE_SYSCALL(madvise);
@@ -9,18 +9,14 @@
 #include "../vfs/uio.h"
 #include "../process.h"
 
-IMPLEMENT_SYSCALL(process_create, 2) {
+/* a NULL path pointer means the path follows the arguments inline */
+IMPLEMENT_SYSCALL_PAYLOAD(process_create, 2) {
     char pathname[PATH_MAX + 1];
 
     vaddr_t pathname_ptr = seL4_GetMR(1);
-    int pathlen = seL4_GetMR(2);
-    if (pathlen > PATH_MAX) {
-        return return_word(-ENAMETOOLONG);
-    }
-
-    int err = copy_in(cspace, proc->addrspace, proc, pathname_ptr, pathlen, pathname, me);
-    if (err) return return_word(-EINVAL);
-    pathname[pathlen] = '\0';
+    size_t pathlen = seL4_GetMR(2);
+    int err = get_pathname(cspace, proc, pathname_ptr, pathlen, 3, nargs, pathname, me);
+    if (err) return return_word(err);
 
     pid_t pid = start_process(cspace, pathname, NULL, false, me);
 
@@ -59,9 +55,14 @@ IMPLEMENT_SYSCALL(process_status, 2) {
     uintptr_t dest = seL4_GetMR(1);
     int max = seL4_GetMR(2);
     if (max <= 0) return return_word(0);
-    if (max > MAX_PROCS) max = MAX_PROCS;
-    
+    if ((size_t) max > process_count()) max = process_count();
+    if (max == 0) return return_word(0);
+    /* inline we can only copy out to pages that are already there */
+    if (me == NULL && !range_resident(proc->addrspace, dest, max * sizeof(sos_process_t)))
+        return retry_in_coroutine();
+
     sos_process_t *processes = malloc(max * sizeof(sos_process_t));
+    if (processes == NULL) return return_word(-ENOMEM);
     int count = get_processes(processes, max);
     int err = copy_out(cspace, proc->addrspace, proc, dest, count * sizeof(sos_process_t), processes, me);
     free(processes);
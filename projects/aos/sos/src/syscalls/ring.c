@@ -0,0 +1,334 @@
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sel4runtime.h>
+
+#include "syscall.h"
+#include "ring.h"
+#include "files.h"
+#include "time.h"
+
+#include "../irq.h"
+#include "../coroutine/picoro.h"
+#include "../coroutine/sched.h"
+#include "../process.h"
+
+/*
+ * io_uring style syscall ring.
+ *
+ * The process queues sos_sqe_t entries in a page it shares with us and
+ * rings the doorbell, a badged cap to SOS's notification that ring_setup
+ * hands out. Signalling it never blocks and needs no reply object, and
+ * since signals coalesce into one bit, SOS checks every ring for new
+ * entries when the doorbell goes off. Every entry is run in a coroutine of
+ * its own, so a batch of reads keeps several NFS requests in flight, and
+ * posts a sos_cqe_t that the process reaps straight from the shared page.
+ * Waiting for completions still takes a ring_enter call.
+ *
+ * The ring page is mapped in the process and in SOS's frame window. Both
+ * mappings are normal cacheable memory, so release/acquire accesses to the
+ * indices are all the synchronisation needed. The process may scribble
+ * over the whole page at any time, so the indices we own live here and
+ * are only ever copied out.
+ */
+
+typedef struct ring_op {
+    sos_sqe_t sqe;
+    cspace_t *cspace;
+    process_t *proc;
+    coro_t coro;
+    /* cuts a blocked operation short, set while the op sleeps */
+    void (*cancel)(void *data);
+    void *cancel_data;
+    struct ring_op *prev;
+    struct ring_op *next;
+} ring_op_t;
+
+struct ring {
+    process_t *proc;            /* owner */
+    cspace_t *cspace;           /* SOS's cspace, for ops started by the doorbell */
+    frame_ref_t frame;          /* pinned frame backing the shared page */
+    sos_ring_t *shared;         /* the shared page in SOS's frame window */
+    uint32_t sq_head;           /* next entry to consume */
+    uint32_t cq_tail;           /* next completion slot */
+    unsigned inflight;          /* number of ops on the ops list */
+    ring_op_t *ops;             /* ops in flight */
+    bool dead;                  /* owner is being torn down */
+    coro_t waiter;              /* ring_enter waiting for a completion */
+    coro_t drain;               /* ring_destroy waiting for inflight to drop to 0 */
+    seL4_CPtr doorbell;         /* doorbell cap in the owner's cspace */
+    struct ring *prev;          /* previous ring on the rings list */
+    struct ring *next;          /* next ring on the rings list */
+};
+
+/* every ring that is set up, checked when the doorbell is rung */
+static struct ring *rings;
+/* badged notification every doorbell cap is copied from */
+static seL4_CPtr ring_doorbell;
+
+static void ring_post(struct ring *ring, uint64_t user_data, int64_t res) {
+    sos_cqe_t *cqe = &ring->shared->cq[ring->cq_tail & (SOS_RING_ENTRIES - 1)];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    ring->cq_tail++;
+    __atomic_store_n(&ring->shared->cq_tail, ring->cq_tail, __ATOMIC_RELEASE);
+
+    if (ring->waiter) {
+        coro_t c = ring->waiter;
+        ring->waiter = NULL;
+        sched_wake(c, NULL);
+    }
+}
+
+static void ring_finish(struct ring *ring, ring_op_t *op, int64_t res) {
+    if (op->prev) op->prev->next = op->next;
+    else ring->ops = op->next;
+    if (op->next) op->next->prev = op->prev;
+    ring->inflight--;
+
+    ring_post(ring, op->sqe.user_data, res);
+    free(op);
+
+    if (ring->inflight == 0 && ring->drain) {
+        coro_t c = ring->drain;
+        ring->drain = NULL;
+        sched_wake(c, NULL);
+    }
+}
+
+static void *_ring_op_impl(void *data) {
+    ring_op_t *op = data;
+    process_t *proc = op->proc;
+    sos_sqe_t *sqe = &op->sqe;
+    int64_t res;
+
+    if (proc->ring->dead) {
+        /* queued before the owner died, don't bother */
+        res = -EINTR;
+    } else {
+        switch (sqe->op) {
+        case SOS_OP_OPEN: {
+            char pathname[PATH_MAX + 1];
+            /* no message registers to take an inline path from */
+            res = get_pathname(op->cspace, proc, sqe->addr, sqe->len, 1, 0, pathname, op->coro);
+            if (res == 0) res = file_open(proc, pathname, sqe->arg, op->coro);
+            break;
+        }
+        case SOS_OP_READ:
+        case SOS_OP_WRITE:
+            /* a console read cannot borrow proc's kill hook, the process
+             * may be blocked in a syscall that owns it */
+            res = file_read_write(op->cspace, proc, sqe->fd, sqe->addr, sqe->len, sqe->op == SOS_OP_WRITE,
+                                  false, op->coro);
+            break;
+        case SOS_OP_READV:
+        case SOS_OP_WRITEV:
+            res = file_read_write_vec(op->cspace, proc, sqe->fd, sqe->addr, sqe->len, sqe->op == SOS_OP_WRITEV,
+                                      false, op->coro);
+            break;
+        case SOS_OP_CLOSE:
+            res = file_close(proc, sqe->fd, op->coro);
+            break;
+        case SOS_OP_USLEEP:
+            res = timer_sleep(sqe->arg, &op->cancel, &op->cancel_data, op->coro);
+            break;
+        default:
+            res = -ENOSYS;
+        }
+    }
+
+    ring_finish(proc->ring, op, res);
+    return NULL;
+}
+
+/* Start the operation described by sqe. Its completion is posted later. */
+static void ring_start(cspace_t *cspace, process_t *proc, sos_sqe_t *sqe) {
+    struct ring *ring = proc->ring;
+    if (sqe->op == SOS_OP_NOP) {
+        ring_post(ring, sqe->user_data, 0);
+        return;
+    }
+
+    ring_op_t *op = malloc(sizeof(ring_op_t));
+    coro_t c = op ? coroutine(_ring_op_impl) : NULL;
+    if (c == NULL) {
+        free(op);
+        ring_post(ring, sqe->user_data, -ENOMEM);
+        return;
+    }
+
+    op->sqe = *sqe;
+    op->cspace = cspace;
+    op->proc = proc;
+    op->coro = c;
+    op->cancel = NULL;
+    op->cancel_data = NULL;
+    op->prev = NULL;
+    op->next = ring->ops;
+    if (ring->ops) ring->ops->prev = op;
+    ring->ops = op;
+    ring->inflight++;
+    sched_wake(c, op);
+}
+
+/*
+ * Consume submitted entries, as long as their completions are guaranteed
+ * a free CQ slot. Entries left behind are picked up by the next ring_enter,
+ * once the process has reaped some completions.
+ */
+static void ring_consume(cspace_t *cspace, process_t *proc) {
+    struct ring *ring = proc->ring;
+    sos_ring_t *shared = ring->shared;
+    uint32_t tail = __atomic_load_n(&shared->sq_tail, __ATOMIC_ACQUIRE);
+    if (tail - ring->sq_head > SOS_RING_ENTRIES) {
+        ZF_LOGE("%s (%d) submitted a bogus sq_tail %u", proc->command, proc->pid, tail);
+        return;
+    }
+
+    while (ring->sq_head != tail) {
+        uint32_t unreaped = ring->cq_tail - shared->cq_head;
+        if (ring->inflight + unreaped >= SOS_RING_ENTRIES) break;
+
+        /* copy it first, the process can rewrite the slot under us */
+        sos_sqe_t sqe = shared->sq[ring->sq_head & (SOS_RING_ENTRIES - 1)];
+        ring->sq_head++;
+        ring_start(cspace, proc, &sqe);
+    }
+    __atomic_store_n(&shared->sq_head, ring->sq_head, __ATOMIC_RELEASE);
+}
+
+static int ring_doorbell_irq(void *data, seL4_Word irq, seL4_IRQHandler irq_handler) {
+    (void) data;
+    (void) irq;
+    (void) irq_handler;
+    for (struct ring *ring = rings; ring != NULL; ring = ring->next) {
+        if (ring->dead || ring->proc->state == PROC_TO_BE_KILLED) continue;
+        if (ring->sq_head != __atomic_load_n(&ring->shared->sq_tail, __ATOMIC_ACQUIRE))
+            ring_consume(ring->cspace, ring->proc);
+    }
+    return 0;
+}
+
+void ring_init(void) {
+    int err = sos_register_soft_irq(ring_doorbell_irq, NULL, &ring_doorbell);
+    ZF_LOGF_IF(err, "Failed to register syscall ring doorbell");
+}
+
+IMPLEMENT_SYSCALL(ring_setup, 0) {
+    if (proc->ring != NULL) return return_word(proc->ring->doorbell);
+
+    struct ring *ring = calloc(1, sizeof(struct ring));
+    if (ring == NULL) return return_word(-ENOMEM);
+
+    ring->doorbell = cspace_alloc_slot(&(proc->cspace));
+    if (ring->doorbell == seL4_CapNull) {
+        free(ring);
+        return return_word(-ENOMEM);
+    }
+    if (cspace_copy(&(proc->cspace), ring->doorbell, cspace, ring_doorbell, seL4_CanWrite)) {
+        cspace_free_slot(&(proc->cspace), ring->doorbell);
+        free(ring);
+        return return_word(-ENOMEM);
+    }
+
+    region_t *region;
+    seL4_ARM_VMAttributes attrs = seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever;
+    int err = as_define_region(proc->addrspace, SOS_RING_VADDR, PAGE_SIZE_4K, seL4_ReadWrite, attrs, &region);
+    if (err) {
+        cspace_delete(&(proc->cspace), ring->doorbell);
+        cspace_free_slot(&(proc->cspace), ring->doorbell);
+        free(ring);
+        return return_word(err);
+    }
+
+    pte_t pte;
+    err = alloc_map_frame(proc->addrspace, cspace, SOS_RING_VADDR, seL4_ReadWrite, attrs, &pte, me, true);
+    if (err) {
+        ZF_LOGE("Failed to map syscall ring");
+        as_destroy_region(proc->addrspace, cspace, region, false, me);
+        cspace_delete(&(proc->cspace), ring->doorbell);
+        cspace_free_slot(&(proc->cspace), ring->doorbell);
+        free(ring);
+        return return_word(-ENOMEM);
+    }
+
+    ring->frame = pte.frame;
+    ring->shared = (sos_ring_t *) frame_data(pte.frame);
+    memset(ring->shared, 0, PAGE_SIZE_4K);
+    ring->proc = proc;
+    ring->cspace = cspace;
+    ring->next = rings;
+    if (rings) rings->prev = ring;
+    rings = ring;
+    proc->ring = ring;
+    return return_word(ring->doorbell);
+}
+
+static void ring_wait_kill_hook(void *data) {
+    struct ring *ring = data;
+    coro_t c = ring->waiter;
+    ring->waiter = NULL;
+    /* a completion may have queued it already */
+    if (resumable(c)) resume(c, NULL);
+}
+
+/*
+ * Consumes the submission queue and, if asked to wait, blocks until there
+ * is at least one completion to reap.
+ */
+IMPLEMENT_SYSCALL(ring_enter, 1) {
+    bool wait = seL4_GetMR(1);
+    struct ring *ring = proc->ring;
+    if (ring == NULL) return return_word(-EINVAL);
+
+    ring_consume(cspace, proc);
+
+    while (wait && ring->inflight > 0 && ring->cq_tail == ring->shared->cq_head &&
+           proc->state != PROC_TO_BE_KILLED) {
+        if (me == NULL) return retry_in_coroutine();
+        ring->waiter = me;
+        proc->kill_hook = ring_wait_kill_hook;
+        proc->kill_hook_data = ring;
+        yield(NULL);
+        proc->kill_hook = proc->kill_hook_data = NULL;
+        ring->waiter = NULL;
+    }
+    return return_word(0);
+}
+
+void ring_destroy(process_t *proc, coro_t coro) {
+    struct ring *ring = proc->ring;
+    if (ring == NULL) return;
+    ring->dead = true;
+    if (ring->prev) ring->prev->next = ring->next;
+    else rings = ring->next;
+    if (ring->next) ring->next->prev = ring->prev;
+
+    /* a cancel hook may finish its op right away, so rescan every time */
+    bool cancelled;
+    do {
+        cancelled = false;
+        for (ring_op_t *op = ring->ops; op != NULL; op = op->next) {
+            if (op->cancel) {
+                void (*cancel)(void *data) = op->cancel;
+                op->cancel = NULL;
+                cancel(op->cancel_data);
+                cancelled = true;
+                break;
+            }
+        }
+    } while (cancelled);
+
+    while (ring->inflight > 0) {
+        ZF_LOGD("waiting for %u ring ops of %d", ring->inflight, proc->pid);
+        ring->drain = coro;
+        yield(NULL);
+    }
+
+    /* the frame itself goes with the address space */
+    unpin_frame(ring->frame);
+    free(ring);
+    proc->ring = NULL;
+}
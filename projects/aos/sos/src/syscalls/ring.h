@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <sel4runtime.h>
+#include "syscall.h"
+
+/* definition from sos.h */
+#define SOS_RING_VADDR   (0xA000001000)
+#define SOS_RING_ENTRIES 64
+
+#define SOS_OP_NOP    0
+#define SOS_OP_OPEN   1
+#define SOS_OP_READ   2
+#define SOS_OP_WRITE  3
+#define SOS_OP_CLOSE  4
+#define SOS_OP_USLEEP 5
+#define SOS_OP_READV  6
+#define SOS_OP_WRITEV 7
+
+typedef struct {
+    uint32_t op;
+    int32_t  fd;
+    uint64_t addr;
+    uint64_t len;
+    uint64_t arg;
+    uint64_t user_data;
+} sos_sqe_t;
+
+typedef struct {
+    uint64_t user_data;
+    int64_t  res;
+} sos_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    sos_sqe_t sq[SOS_RING_ENTRIES];
+    sos_cqe_t cq[SOS_RING_ENTRIES];
+} sos_ring_t;
+
+compile_time_assert("ring fits in a page", sizeof(sos_ring_t) <= PAGE_SIZE_4K);
+compile_time_assert("ring entries power of 2", (SOS_RING_ENTRIES & (SOS_RING_ENTRIES - 1)) == 0);
+
+/* Register the doorbell notification, before any process sets up a ring */
+void ring_init(void);
+
+DEFINE_SYSCALL(ring_setup);
+DEFINE_SYSCALL(ring_enter);
+
+/*
+ * Tear down the syscall ring of a dying process. Cancels what can be
+ * cancelled and waits for every other operation in flight to complete, as
+ * they still use the process's fds and address space.
+ */
+void ring_destroy(process_t *proc, coro_t coro);
@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <limits.h>
 #include <cspace/cspace.h>
 #include <aos/sel4_zf_logif.h>
 #include <aos/debug.h>
@@ -7,8 +9,10 @@
 #include "time.h"
 #include "memory.h"
 #include "process.h"
+#include "ring.h"
+#include "../utils.h"
 
-#define SYSCALL_NUM (18)
+#define SYSCALL_NUM (23)
 
 static syscall_t *syscalls[SYSCALL_NUM];
 
@@ -16,27 +20,45 @@ static syscall_t *syscalls[SYSCALL_NUM];
 // REMEMBER TO CHANGE SYSCALL_NUM
 void init_syscall() {
     START_INSTALLING_SYSCALLS();
-    INSTALL_SYSCALL(open);
-    INSTALL_SYSCALL(read);
-    INSTALL_SYSCALL(write);
-    INSTALL_SYSCALL(close);
-    INSTALL_SYSCALL(usleep);
-    INSTALL_SYSCALL(time_stamp);
-    INSTALL_SYSCALL(brk);
-    INSTALL_SYSCALL(getdirent);
-    INSTALL_SYSCALL(stat);
-    INSTALL_SYSCALL(process_create);
-    INSTALL_SYSCALL(process_delete);
-    INSTALL_SYSCALL(my_id);
-    INSTALL_SYSCALL(process_status);
-    INSTALL_SYSCALL(process_wait);
-    INSTALL_SYSCALL(mmap);
-    INSTALL_SYSCALL(munmap);
-    INSTALL_SYSCALL(timer_callback);
-    INSTALL_SYSCALL(timer_ack);
+    INSTALL_SYSCALL(open, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(read, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(write, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(close, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(usleep, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(time_stamp, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(brk, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(getdirent, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(stat, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(process_create, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(process_delete, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(my_id, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(process_status, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(process_wait, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(mmap, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(munmap, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(timer_callback, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(timer_ack, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(ring_setup, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(ring_enter, SYSCALL_NONBLOCKING);
+    INSTALL_SYSCALL(readv, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(writev, SYSCALL_BLOCKING);
+    INSTALL_SYSCALL(madvise, SYSCALL_BLOCKING);
     // did you change SYSCALL_NUM?
 }
 
+static bool syscall_args_match(syscall_t *syscall, size_t num_args) {
+    return num_args == syscall->args || (syscall->payload && num_args > syscall->args);
+}
+
+/*
+ * Creating a coroutine may invoke the kernel, and any invocation with
+ * more than seL4_FastMessageRegisters arguments overwrites the message
+ * registers beyond those. Longer messages are saved here first and put
+ * back once the coroutine runs.
+ */
+static seL4_Word saved_msg[seL4_MsgMaxLength];
+static size_t saved_msg_len;
+
 struct syscall_args {
     cspace_t *cspace;
     seL4_Word badge;
@@ -47,6 +69,12 @@ struct syscall_args {
     coro_t coro;
 };
 
+/* The coroutine handle_syscall is currently running for the first time.
+ * If it finishes without yielding it leaves its reply to the syscall loop. */
+static coro_t inline_coro;
+static bool inline_replied;
+static seL4_MessageInfo_t inline_reply;
+
 static void *_handle_syscall_impl(void *args) {
     struct syscall_args *sargs = (struct syscall_args *) args;
     cspace_t *cspace = sargs->cspace;
@@ -55,6 +83,11 @@ static void *_handle_syscall_impl(void *args) {
     process_t *proc = sargs->proc;
     coro_t coro = sargs->coro;
 
+    if (saved_msg_len) {
+        memcpy(seL4_GetIPCBuffer()->msg, saved_msg, saved_msg_len * sizeof(seL4_Word));
+        saved_msg_len = 0;
+    }
+
     /* get the first word of the message, which in the SOS protocol is the number
      * of the SOS "syscall". */
     seL4_Word syscall_number = seL4_GetMR(0);
@@ -63,19 +96,23 @@ static void *_handle_syscall_impl(void *args) {
     if (syscall_number >= SYSCALL_NUM) {
         ZF_LOGE("Unknown syscall %lu\n", syscall_number);
         reply_msg = return_error();
-    } else if (syscalls[syscall_number]->args != sargs->num_args) {
+    } else if (!syscall_args_match(syscalls[syscall_number], sargs->num_args)) {
         ZF_LOGE("Unmatch syscall %s\n", syscalls[syscall_number]->name);
         reply_msg = return_error();
     } else {
         ZF_LOGD("%s (%d) calling syscall %s\n", proc->command, proc->pid, syscalls[syscall_number]->name);
-        reply_msg = syscalls[syscall_number]->implementation(cspace, proc, coro);
+        reply_msg = syscalls[syscall_number]->implementation(cspace, proc, sargs->num_args, coro);
     }
     // the only syscall that doesn't reply is to kill oneself
     bool killed = seL4_MessageInfo_get_length(reply_msg) == 0;
-    if (!killed) seL4_Send(reply, reply_msg);
-    cspace_delete(cspace, reply);
-    cspace_free_slot(cspace, reply);
-    ut_free(reply_ut);
+    if (!killed && inline_coro == coro) {
+        /* never blocked, let the syscall loop reply with seL4_ReplyRecv */
+        inline_replied = true;
+        inline_reply = reply_msg;
+    } else {
+        if (!killed) seL4_Send(reply, reply_msg);
+        reply_free(reply, reply_ut);
+    }
     if (!killed) {
         if (proc->state == PROC_TO_BE_KILLED) {
             // die?
@@ -88,9 +125,29 @@ static void *_handle_syscall_impl(void *args) {
     return NULL;
 }
 
-void handle_syscall(cspace_t *cspace, seL4_Word badge, size_t num_args, seL4_CPtr reply, ut_t *reply_ut, process_t *proc) {
-    proc->state = PROC_BLOCKED;
+bool handle_syscall(cspace_t *cspace, seL4_Word badge, size_t num_args, seL4_CPtr reply, ut_t *reply_ut, process_t *proc,
+                    seL4_MessageInfo_t *reply_msg) {
+    /* fast path: run non-blocking syscalls right here on the loop stack */
+    seL4_Word syscall_number = seL4_GetMR(0);
+    if (syscall_number < SYSCALL_NUM && !syscalls[syscall_number]->may_block &&
+        syscall_args_match(syscalls[syscall_number], num_args)) {
+        ZF_LOGD("%s (%d) calling syscall %s inline\n", proc->command, proc->pid, syscalls[syscall_number]->name);
+        *reply_msg = syscalls[syscall_number]->implementation(cspace, proc, num_args, NULL);
+        if (seL4_MessageInfo_get_label(*reply_msg) != SYSCALL_RETRY_LABEL) return true;
+    }
+
+    if (num_args + 1 > seL4_FastMessageRegisters) {
+        saved_msg_len = num_args + 1;
+        memcpy(saved_msg, seL4_GetIPCBuffer()->msg, saved_msg_len * sizeof(seL4_Word));
+    }
+
     coro_t c = coroutine(_handle_syscall_impl);
+    if (c == NULL) {
+        ZF_LOGE("No coroutine for %s (%d) syscall %lu", proc->command, proc->pid, syscall_number);
+        *reply_msg = return_word(-ENOMEM);
+        return true;
+    }
+    proc->state = PROC_BLOCKED;
     struct syscall_args args = {
         .cspace = cspace,
         .badge = badge,
@@ -100,5 +157,22 @@ void handle_syscall(cspace_t *cspace, seL4_Word badge, size_t num_args, seL4_CPt
         .proc = proc,
         .coro = c
     };
+    inline_coro = c;
+    inline_replied = false;
     resume(c, &args);
+    inline_coro = NULL;
+    *reply_msg = inline_reply;
+    return inline_replied;
+}
+
+int get_pathname(cspace_t *cspace, process_t *proc, vaddr_t ptr, size_t len, size_t mr, size_t nargs, char *dest,
+                 coro_t me) {
+    if (len > PATH_MAX) return -ENAMETOOLONG;
+    if (ptr == 0) {
+        if (get_payload(dest, len, mr, nargs)) return -EINVAL;
+    } else if (copy_in(cspace, proc->addrspace, proc, ptr, len, dest, me)) {
+        return -EINVAL;
+    }
+    dest[len] = '\0';
+    return 0;
 }
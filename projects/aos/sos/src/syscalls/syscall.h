@@ -1,7 +1,10 @@
 #pragma once
 
+#include <assert.h>
+#include <string.h>
 #include <sel4runtime.h>
 #include <sel4/sel4.h>
+#include <utils/util.h>
 #include <cspace/cspace.h>
 #include "../process.h"
 #include "../ut.h"
@@ -9,25 +12,44 @@
 
 #define SYSCALL_IMPL_(name) _syscall_##name##_impl
 
-#define SYSCALL_PARAMS cspace_t *cspace, process_t *proc, coro_t me
+/* me is NULL when a non-blocking syscall runs inline on the syscall loop stack,
+ * nargs is the number of message registers after the syscall number */
+#define SYSCALL_PARAMS cspace_t *cspace, process_t *proc, size_t nargs, coro_t me
+
+/* whether a syscall may yield, given to INSTALL_SYSCALL */
+#define SYSCALL_BLOCKING    true
+#define SYSCALL_NONBLOCKING false
+
+/* label of the sentinel returned by retry_in_coroutine */
+#define SYSCALL_RETRY_LABEL 1
 
 #define DEFINE_SYSCALL(syscall_name) \
     seL4_MessageInfo_t SYSCALL_IMPL_(syscall_name)(SYSCALL_PARAMS); \
     extern syscall_t syscall_##syscall_name; \
     extern int syscall_no_##syscall_name
 
-#define IMPLEMENT_SYSCALL(syscall_name, syscall_args) \
+#define IMPLEMENT_SYSCALL_(syscall_name, syscall_args, has_payload) \
     int syscall_no_##syscall_name = -1; \
     syscall_t syscall_##syscall_name = { \
         .name = #syscall_name, \
         .args = syscall_args, \
+        .payload = has_payload, \
         .implementation = SYSCALL_IMPL_(syscall_name) \
     }; \
     seL4_MessageInfo_t SYSCALL_IMPL_(syscall_name)(SYSCALL_PARAMS)
 
+#define IMPLEMENT_SYSCALL(syscall_name, syscall_args) \
+    IMPLEMENT_SYSCALL_(syscall_name, syscall_args, false)
+
+/* A syscall whose syscall_args arguments may be followed by an inline
+ * payload, see get_payload */
+#define IMPLEMENT_SYSCALL_PAYLOAD(syscall_name, syscall_args) \
+    IMPLEMENT_SYSCALL_(syscall_name, syscall_args, true)
+
 #define START_INSTALLING_SYSCALLS() int sisline = __LINE__
-#define INSTALL_SYSCALL(syscall_name) \
+#define INSTALL_SYSCALL(syscall_name, blocking) \
     syscall_no_##syscall_name = __LINE__ - sisline - 1; \
+    syscall_##syscall_name.may_block = blocking; \
     syscalls[syscall_no_##syscall_name] = &syscall_##syscall_name; \
     printf("Registered syscall " #syscall_name " with code %d\n", syscall_no_##syscall_name)
 
@@ -45,12 +67,57 @@ static inline seL4_MessageInfo_t no_return() {
     return seL4_MessageInfo_new(0, 0, 0, 0);
 }
 
-void handle_syscall(cspace_t *cspace, seL4_Word badge, size_t num_args, seL4_CPtr reply, ut_t *reply_ut, process_t *proc);
+/*
+ * Copy len bytes of inline payload, packed into the message registers from
+ * mr onwards, to dest. Returns -1 if the message is too short to hold them.
+ * Like any message register they are lost once the syscall does any IPC,
+ * so fetch them first.
+ */
+static inline int get_payload(void *dest, size_t len, size_t mr, size_t nargs) {
+    if (mr + DIV_ROUND_UP(len, sizeof(seL4_Word)) > nargs + 1) return -1;
+    memcpy(dest, &seL4_GetIPCBuffer()->msg[mr], len);
+    return 0;
+}
+
+/* Reply with word in MR0, followed by len bytes of src packed into MR1 onwards */
+static inline seL4_MessageInfo_t return_payload(seL4_Word word, void *src, size_t len) {
+    assert(1 + DIV_ROUND_UP(len, sizeof(seL4_Word)) <= seL4_MsgMaxLength);
+    seL4_SetMR(0, word);
+    memcpy(&seL4_GetIPCBuffer()->msg[1], src, len);
+    return seL4_MessageInfo_new(0, 0, 0, 1 + DIV_ROUND_UP(len, sizeof(seL4_Word)));
+}
+
+/* A non-blocking syscall running inline (me == NULL) that finds it has to
+ * block after all returns this, without having touched the message
+ * registers, and is then run again in a coroutine. */
+static inline seL4_MessageInfo_t retry_in_coroutine() {
+    return seL4_MessageInfo_new(SYSCALL_RETRY_LABEL, 0, 0, 0);
+}
+
+/*
+ * Handle a syscall, inline if it is non-blocking and otherwise in a new
+ * coroutine, which then owns reply/reply_ut. If the syscall completes
+ * without blocking this returns true, the caller keeps the reply object
+ * and must reply with *reply_msg itself (the message registers are
+ * already set).
+ */
+bool handle_syscall(cspace_t *cspace, seL4_Word badge, size_t num_args, seL4_CPtr reply, ut_t *reply_ut, process_t *proc,
+                    seL4_MessageInfo_t *reply_msg);
 void init_syscall();
 
+/*
+ * Fetch a pathname argument of len bytes into dest, which must hold
+ * PATH_MAX + 1. If ptr is NULL the path was sent inline from message
+ * register mr onwards, otherwise it is copied in from user memory.
+ */
+int get_pathname(cspace_t *cspace, process_t *proc, vaddr_t ptr, size_t len, size_t mr, size_t nargs, char *dest,
+                 coro_t me);
+
 typedef struct syscall {
     char *name;
     size_t args;
+    bool may_block;
+    bool payload;
     seL4_MessageInfo_t (*implementation)(SYSCALL_PARAMS);
 } syscall_t;
 
@@ -1,18 +1,24 @@
 #include <assert.h>
 #include <sel4runtime.h>
-//#include <clock/clock.h>
+#include <sos/gen_config.h>
+#include <clock/clock.h>
+#include <clock/timer_ring.h>
 
 #include "syscall.h"
 #include "time.h"
 
 #include "../coroutine/picoro.h"
+#include "../coroutine/sched.h"
+#include "../irq.h"
 #include "../process.h"
+#include "../vm/frame_table.h"
+#include "../vm/pagetable.h"
 
 extern seL4_CPtr timer_ep;
 extern seL4_IRQHandler *timer_irq_handler;
 extern pid_t clock_driver_pid;
 
-typedef void (*timer_callback_t)(uint32_t id, void *data);
+typedef void (*sos_timer_callback_t)(uint32_t id, void *data);
 
 IMPLEMENT_SYSCALL(time_stamp, 0) {
     (void) proc;
@@ -20,59 +26,167 @@ IMPLEMENT_SYSCALL(time_stamp, 0) {
     return return_word(get_time());
 }
 
+struct usleep_data {
+    coro_t coro;
+    seL4_Word timeoutid;
+    /* the expiry has been delivered */
+    bool fired;
+};
+
 void usleep_callback(unsigned int id, void *data) {
     (void) id;
-    resume((coro_t) data, NULL);
+    struct usleep_data *d = data;
+    d->fired = true;
+    sched_wake(d->coro, NULL);
 }
 
-struct usleep_kill_hook_data {
-    coro_t coro;
-    seL4_Word timeoutid;
-};
+#ifdef CONFIG_SOS_INTERNAL_TIMER
+
+static bool usleep_expired(uint32_t id, seL4_Word data1, seL4_Word data2) {
+    (void) data2;
+    usleep_callback(id, (void *) data1);
+    return true;
+}
+
+/* Arm a timeout that calls usleep_callback, returns its id or 0 */
+static seL4_Word timeout_add(uint64_t delay, struct usleep_data *d) {
+    return register_timer(delay, usleep_expired, (seL4_Word) d, 0);
+}
+
+/* Cancel a timeout whose expiry has not been delivered */
+static void timeout_remove(seL4_Word id) {
+    remove_timer(id);
+}
+
+#else
+
+/* the expiry ring outlives driver restarts, so it is ours, not the driver's */
+static frame_ref_t timer_ring_frame;
+static timer_ring_t *timer_ring;
+static uint32_t timer_ring_head;
+static seL4_CPtr timer_ring_ntfn;
+
+/* Run the callback of everything the driver has posted */
+static void timer_ring_drain(void) {
+    uint32_t tail = __atomic_load_n(&timer_ring->tail, __ATOMIC_ACQUIRE);
+    if (tail - timer_ring_head > TIMER_RING_ENTRIES) {
+        ZF_LOGE("clock driver posted a bogus tail %u", tail);
+        return;
+    }
+
+    while (timer_ring_head != tail) {
+        timer_expiry_t e = timer_ring->entries[timer_ring_head & (TIMER_RING_ENTRIES - 1)];
+        timer_ring_head++;
+        ((sos_timer_callback_t) e.data1)(e.id, (void *) e.data2);
+    }
+    /* pairs with the driver setting stalled and then re-reading head */
+    __atomic_store_n(&timer_ring->head, timer_ring_head, __ATOMIC_SEQ_CST);
+
+    /* the driver is sitting on expiries that did not fit, let it retry */
+    if (__atomic_exchange_n(&timer_ring->stalled, 0, __ATOMIC_SEQ_CST) && is_clock_driver_ready()) {
+        seL4_Send(timer_ep, seL4_MessageInfo_new(0, 0, 0, 1));
+    }
+}
+
+static int timer_ring_irq(void *data, seL4_Word irq, seL4_IRQHandler irq_handler) {
+    (void) data;
+    (void) irq;
+    (void) irq_handler;
+    timer_ring_drain();
+    return 0;
+}
+
+void timer_ring_init(void) {
+    timer_ring_frame = alloc_sos_frame();
+    ZF_LOGF_IF(timer_ring_frame == NULL_FRAME, "Failed to allocate timer ring");
+    timer_ring = (timer_ring_t *) frame_data(timer_ring_frame);
+    memset(timer_ring, 0, PAGE_SIZE_4K);
+    int err = sos_register_soft_irq(timer_ring_irq, NULL, &timer_ring_ntfn);
+    ZF_LOGF_IF(err, "Failed to register timer ring notification");
+}
+
+seL4_Error timer_ring_map(cspace_t *cspace, process_t *proc, coro_t coro) {
+    seL4_CPtr ntfn = cspace_alloc_slot(&(proc->cspace));
+    if (ntfn == seL4_CapNull) return seL4_NotEnoughMemory;
+    if (ntfn != TIMER_RING_NTFN_SLOT) {
+        ZF_LOGE("Timer ring notification ended up in slot %lu", ntfn);
+        return seL4_IllegalOperation;
+    }
+    seL4_Error err = cspace_copy(&(proc->cspace), ntfn, cspace, timer_ring_ntfn, seL4_CanWrite);
+    if (err) return err;
+
+    seL4_ARM_VMAttributes attrs = seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever;
+    err = as_define_region(proc->addrspace, TIMER_RING_VADDR, PAGE_SIZE_4K, seL4_ReadWrite, attrs, NULL);
+    if (err) return err;
+    return sos_clone_and_map_device_frame(proc->addrspace, cspace, frame_page(timer_ring_frame), TIMER_RING_VADDR,
+                                          seL4_ReadWrite, attrs, coro);
+}
+
+static seL4_Word timeout_add(uint64_t delay, struct usleep_data *d) {
+    seL4_SetMR(0, delay);
+    seL4_SetMR(1, usleep_callback);
+    seL4_SetMR(2, d);
+    seL4_Call(timer_ep, seL4_MessageInfo_new(0, 0, 0, 3));
+    return seL4_GetMR(0);
+}
+
+static void timeout_remove(seL4_Word id) {
+    seL4_SetMR(0, id);
+    seL4_Call(timer_ep, seL4_MessageInfo_new(0, 0, 0, 2));
+    /* too late, it is in the ring already */
+    if (seL4_GetMR(0) != 0) timer_ring_drain();
+}
+
+#endif /* CONFIG_SOS_INTERNAL_TIMER */
 
 void usleep_kill_hook(void *data) {
-    struct usleep_kill_hook_data *hd = data;
+    struct usleep_data *hd = data;
     ZF_LOGD("removing timeout %ld", hd->timeoutid);
-    if (is_clock_driver_ready()) {
-        seL4_SetMR(0, hd->timeoutid);
-        seL4_Call(timer_ep, seL4_MessageInfo_new(0, 0, 0, 2));
-    } else {
+#ifndef CONFIG_SOS_INTERNAL_TIMER
+    /* once the driver has posted the expiry it may hand the id out again,
+     * so only ask for it to be removed if we have not seen it yet. Nothing
+     * new can get the id before our call lands, we are not registering. */
+    timer_ring_drain();
+#endif
+    if (!hd->fired && is_clock_driver_ready()) {
+        timeout_remove(hd->timeoutid);
+    } else if (!hd->fired) {
         ZF_LOGE("tried to remove timeout but it looks like clock driver died");
     }
-    resume(hd->coro, NULL);
+    /* the timeout may have fired already and queued us */
+    if (resumable(hd->coro)) resume(hd->coro, NULL);
 }
 
-IMPLEMENT_SYSCALL(usleep, 1) {
+int timer_sleep(unsigned msec, void (**hook)(void *data), void **hook_data, coro_t me) {
     if (!is_clock_driver_ready()) {
         ZF_LOGE("Clock driver is not yet ready! (you bad bad, did you kill my driver? it's probably respawning now)");
-        return return_word(-1);
+        return -1;
     }
-    //register_timer(seL4_GetMR(1) * 1000, usleep_callback, me);
-    seL4_SetMR(0, seL4_GetMR(1) * 1000);
-    seL4_SetMR(1, usleep_callback);
-    seL4_SetMR(2, me);
-    seL4_Call(timer_ep, seL4_MessageInfo_new(0, 0, 0, 3));
-    seL4_Word tid = seL4_GetMR(0);
-    if (tid == 0) {
+    struct usleep_data d = {
+        .coro = me,
+        .fired = false,
+    };
+    d.timeoutid = timeout_add((uint64_t) msec * 1000, &d);
+    if (d.timeoutid == 0) {
         ZF_LOGE("register timeout failed - driver returned 0");
-        return return_word(-1);
+        return -1;
     }
-    struct usleep_kill_hook_data d = {
-        .timeoutid = tid,
-        .coro = me
-    };
-    proc->kill_hook = usleep_kill_hook;
-    proc->kill_hook_data = &d;
+    *hook = usleep_kill_hook;
+    *hook_data = &d;
     yield(NULL);
-    proc->kill_hook = proc->kill_hook_data = NULL;
-    return return_word(0);
+    *hook = *hook_data = NULL;
+    return 0;
+}
+
+IMPLEMENT_SYSCALL(usleep, 1) {
+    return return_word(timer_sleep(seL4_GetMR(1), &proc->kill_hook, &proc->kill_hook_data, me));
 }
 
 IMPLEMENT_SYSCALL(timer_callback, 3) {
     if (proc->pid != clock_driver_pid)
         return return_word(-1);
     unsigned int id = seL4_GetMR(1);
-    timer_callback_t cb = seL4_GetMR(2);
+    sos_timer_callback_t cb = seL4_GetMR(2);
     void *data = seL4_GetMR(3);
     ZF_LOGD("Calling timer callback");
     cb(id, data);
@@ -1,9 +1,24 @@
 #pragma once
 
 #include <sel4runtime.h>
+#include <sos/gen_config.h>
 #include "syscall.h"
 
 DEFINE_SYSCALL(usleep);
 DEFINE_SYSCALL(time_stamp);
 DEFINE_SYSCALL(timer_callback);
 DEFINE_SYSCALL(timer_ack);
+
+#ifndef CONFIG_SOS_INTERNAL_TIMER
+/* Allocate the expiry ring shared with the clock driver and the
+ * notification the driver signals when it has posted to it. */
+void timer_ring_init(void);
+
+/* Give a (new) clock driver the expiry ring and its notification, see
+ * clock/timer_ring.h */
+seL4_Error timer_ring_map(cspace_t *cspace, process_t *proc, coro_t coro);
+#endif
+
+/* Sleep for msec milliseconds. While asleep, *hook/*hook_data are set to a
+ * hook that cancels the timeout and wakes us up early. */
+int timer_sleep(unsigned msec, void (**hook)(void *data), void **hook_data, coro_t me);
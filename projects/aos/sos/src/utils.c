@@ -46,3 +46,35 @@ ut_t *alloc_retype(seL4_CPtr *cptr, seL4_Word type, size_t size_bits)
 
     return ut;
 }
+
+static struct {
+    seL4_CPtr cap;
+    ut_t *ut;
+} reply_pool[REPLY_POOL_MAX];
+static size_t reply_pool_len;
+
+ut_t *reply_alloc(seL4_CPtr *reply)
+{
+    if (reply_pool_len > 0) {
+        reply_pool_len--;
+        *reply = reply_pool[reply_pool_len].cap;
+        return reply_pool[reply_pool_len].ut;
+    }
+    return alloc_retype(reply, seL4_ReplyObject, seL4_ReplyBits);
+}
+
+void reply_free(seL4_CPtr reply, ut_t *reply_ut)
+{
+    /* A reply object that was never used to reply is unbound again by the
+     * kernel the next time it is passed to a receive, so it is safe to
+     * recycle either way. */
+    if (reply_pool_len < REPLY_POOL_MAX) {
+        reply_pool[reply_pool_len].cap = reply;
+        reply_pool[reply_pool_len].ut = reply_ut;
+        reply_pool_len++;
+        return;
+    }
+    cspace_delete(&cspace, reply);
+    cspace_free_slot(&cspace, reply);
+    ut_free(reply_ut);
+}
@@ -18,3 +18,12 @@ extern cspace_t cspace;
 
 /* helper to allocate a ut + cslot, and retype the ut into the cslot */
 ut_t *alloc_retype(seL4_CPtr *cptr, seL4_Word type, size_t size_bits);
+
+/* reply objects are recycled through a pool of up to this many */
+#define REPLY_POOL_MAX 256
+
+/* get a reply object from the pool, retyping a new one if it is empty */
+ut_t *reply_alloc(seL4_CPtr *reply);
+
+/* give a reply object that is no longer waited on back to the pool */
+void reply_free(seL4_CPtr reply, ut_t *reply_ut);
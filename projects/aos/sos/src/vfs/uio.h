@@ -28,8 +28,10 @@ typedef struct uio {
     enum uio_seg segflag;
     enum uio_rw rw;
     pte_t pte;
+    user_cursor_t *cursor;
 } uio_t;
 
 int uio_kinit(uio_t *uio, void *data, size_t size, size_t offset, enum uio_rw rw);
-int uio_uinit(uio_t *uio, vaddr_t data, size_t size, size_t offset, enum uio_rw rw, cspace_t *cspace, process_t *proc, addrspace_t *as, coro_t coro);
+/* uc walks the user buffer and must be set up for the same direction as rw */
+int uio_uinit(uio_t *uio, user_cursor_t *uc, vaddr_t data, size_t size, size_t offset, enum uio_rw rw, coro_t coro);
 void uio_destroy(uio_t *uio, cspace_t *cspace);
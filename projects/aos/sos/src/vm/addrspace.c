@@ -21,9 +21,181 @@ region_t *region_create(vaddr_t vaddr, size_t sz,
     r->attrs = attrs;
     r->mmaped = false;
     r->prev = r->next = NULL;
+    r->left = r->right = r->parent = NULL;
+    r->height = 1;
+    r->gap = r->max_gap = 0;
     return r;
 }
 
+/*
+ * Regions are kept both in a sorted list and in an AVL tree keyed by vbase.
+ * Every node also carries the free gap in front of it and the largest such
+ * gap in its subtree, so lookups and free space searches are O(log n).
+ */
+
+static inline int node_height(region_t *n) {
+    return n ? n->height : 0;
+}
+
+static inline size_t node_max_gap(region_t *n) {
+    return n ? n->max_gap : 0;
+}
+
+/* free page aligned space between the previous region and r */
+static size_t region_gap(region_t *r) {
+    vaddr_t start = r->prev ? ROUND_UP(VEND(r->prev), PAGE_SIZE_4K) : 0;
+    return r->vbase > start ? r->vbase - start : 0;
+}
+
+static void node_update(region_t *n) {
+    n->height = 1 + MAX(node_height(n->left), node_height(n->right));
+    n->max_gap = MAX(n->gap, MAX(node_max_gap(n->left), node_max_gap(n->right)));
+}
+
+/* put new where old hangs off its parent */
+static void tree_replace(addrspace_t *as, region_t *old, region_t *new) {
+    region_t *parent = old->parent;
+    if (parent == NULL) as->region_root = new;
+    else if (parent->left == old) parent->left = new;
+    else parent->right = new;
+    if (new) new->parent = parent;
+}
+
+static region_t *rotate_left(addrspace_t *as, region_t *x) {
+    region_t *y = x->right;
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+    tree_replace(as, x, y);
+    y->left = x;
+    x->parent = y;
+    node_update(x);
+    node_update(y);
+    return y;
+}
+
+static region_t *rotate_right(addrspace_t *as, region_t *x) {
+    region_t *y = x->left;
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+    tree_replace(as, x, y);
+    y->right = x;
+    x->parent = y;
+    node_update(x);
+    node_update(y);
+    return y;
+}
+
+/* recompute n and its ancestors, rebalancing on the way up */
+static void tree_fixup(addrspace_t *as, region_t *n) {
+    while (n != NULL) {
+        node_update(n);
+        int balance = node_height(n->left) - node_height(n->right);
+        if (balance > 1) {
+            if (node_height(n->left->left) < node_height(n->left->right)) rotate_left(as, n->left);
+            n = rotate_right(as, n);
+        } else if (balance < -1) {
+            if (node_height(n->right->right) < node_height(n->right->left)) rotate_right(as, n->right);
+            n = rotate_left(as, n);
+        }
+        n = n->parent;
+    }
+}
+
+static void tree_insert(addrspace_t *as, region_t *r) {
+    region_t **link = &as->region_root, *parent = NULL;
+    while (*link != NULL) {
+        parent = *link;
+        /* equal keys (empty regions) go right, matching list order */
+        link = r->vbase < parent->vbase ? &parent->left : &parent->right;
+    }
+    *link = r;
+    r->parent = parent;
+    tree_fixup(as, r);
+}
+
+static void tree_remove(addrspace_t *as, region_t *z) {
+    region_t *from;
+    if (z->left == NULL || z->right == NULL) {
+        tree_replace(as, z, z->left ? z->left : z->right);
+        from = z->parent;
+    } else {
+        /* splice in the successor, which has no left child */
+        region_t *y = z->right;
+        while (y->left) y = y->left;
+        if (y->parent != z) {
+            from = y->parent;
+            tree_replace(as, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        } else {
+            from = y;
+        }
+        tree_replace(as, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+    }
+    tree_fixup(as, from);
+}
+
+static void region_update_gap(addrspace_t *as, region_t *r) {
+    if (r == NULL) return;
+    r->gap = region_gap(r);
+    tree_fixup(as, r);
+}
+
+void as_region_resized(struct addrspace *as, region_t *reg) {
+    region_update_gap(as, reg);
+    region_update_gap(as, reg->next);
+}
+
+region_t *get_last_region(addrspace_t *as, vaddr_t vaddr) {
+    region_t *n = as->region_root, *last = NULL;
+    while (n != NULL) {
+        if (n->vbase <= vaddr) {
+            last = n;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return last;
+}
+
+region_t *get_region(addrspace_t *as, vaddr_t vaddr) {
+    region_t *ret = get_last_region(as, vaddr);
+    if (ret != NULL && VEND(ret) > vaddr) return ret;
+    return NULL;
+}
+
+/* first gap in n's subtree with sz bytes above base */
+static bool gap_search(region_t *n, vaddr_t base, size_t sz, vaddr_t *found) {
+    if (n == NULL || n->max_gap < sz) return false;
+    if (n->vbase > base) {
+        /* everything in the left subtree and our own gap ends above base */
+        if (gap_search(n->left, base, sz, found)) return true;
+        vaddr_t start = MAX(n->vbase - n->gap, base);
+        if (n->gap >= sz && n->vbase - start >= sz) {
+            *found = start;
+            return true;
+        }
+    }
+    return gap_search(n->right, base, sz, found);
+}
+
+vaddr_t as_find_free(addrspace_t *as, vaddr_t base, vaddr_t top, size_t sz) {
+    base = ROUND_UP(base, PAGE_SIZE_4K);
+    sz = ROUND_UP(sz, PAGE_SIZE_4K);
+    vaddr_t found;
+    if (gap_search(as->region_root, base, sz, &found)) return found;
+
+    /* nothing in between, try after the last region */
+    region_t *last = as->region_root;
+    while (last && last->right) last = last->right;
+    found = last ? MAX(ROUND_UP(VEND(last), PAGE_SIZE_4K), base) : base;
+    if (found + sz > top || found + sz < found) return 0;
+    return found;
+}
+
 addrspace_t *as_create(seL4_CPtr vspace, coro_t coro) {
     addrspace_t *ret = malloc(sizeof(addrspace_t));
     if (ret == NULL) return NULL;
@@ -44,6 +216,11 @@ addrspace_t *as_create(seL4_CPtr vspace, coro_t coro) {
 
 void as_destroy(addrspace_t *as, cspace_t *cspace, coro_t coro) {
     pagetable_destroy(as, cspace, coro);
+    while (as->regions) {
+        region_t *r = as->regions;
+        as->regions = r->next;
+        free(r);
+    }
     free(as);
 }
 
@@ -62,39 +239,38 @@ int as_define_heap(struct addrspace *as, vaddr_t start) {
 int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
         seL4_CapRights_t rights, seL4_ARM_VMAttributes attrs, region_t **ret) {
     ZF_LOGD("as_define_regine: %p-%p", vaddr, vaddr+sz);
-    region_t **curr = &(as->regions);
-    while (*curr != NULL) {
-        if (((*curr)->vbase + (*curr)->memsize) > vaddr) break;
-        curr = &((*curr)->next);
-    }
+    region_t *prev = get_last_region(as, vaddr);
+    region_t *next = prev ? prev->next : as->regions;
+    if (prev != NULL && VEND(prev) > vaddr) return -EINVAL;
+    if (next != NULL && (vaddr + sz) > next->vbase) return -EINVAL;
 
-    if (*curr != NULL && (vaddr + sz) > (*curr)->vbase)
-        return -EINVAL;
-    
     region_t *new_region = region_create(vaddr, sz, rights, attrs);
     if (new_region == NULL)
         return -ENOMEM;
 
-    new_region->next = *curr;
-    /* :bigbrain: */
-    if (as->regions) new_region->prev = (void *)curr - (void *)&(((region_t *)NULL)->next);
-    if (*curr != NULL) (*curr)->prev = new_region;
-    *curr = new_region;
+    new_region->prev = prev;
+    new_region->next = next;
+    if (prev) prev->next = new_region;
+    else as->regions = new_region;
+    if (next) next->prev = new_region;
+
+    new_region->gap = region_gap(new_region);
+    tree_insert(as, new_region);
+    region_update_gap(as, next);
     if (ret != NULL) *ret = new_region;
     return 0;
 }
 
 void as_destroy_region(struct addrspace *as, cspace_t *cspace, region_t *reg, bool unallocate, coro_t me) {
     ZF_LOGD("as_destroy_region: %p-%p", reg->vbase, reg->vbase + reg->memsize);
+    as->gen++;
     if (reg->prev) reg->prev->next = reg->next;
     else as->regions = as->regions->next;
     if (reg->next) reg->next->prev = reg->prev;
-    
-    if (unallocate) {
-        for (vaddr_t curr = reg->vbase; curr < VEND(reg); curr += PAGE_SIZE_4K) {
-            unalloc_frame(as, cspace, curr, me);
-        }
-    }
+    tree_remove(as, reg);
+    region_update_gap(as, reg->next);
+
+    if (unallocate) unalloc_range(as, cspace, reg->vbase, VEND(reg), me);
     free(reg);
 }
 
@@ -102,18 +278,16 @@ void as_shrink_region(struct addrspace *as, cspace_t *cspace, region_t *reg, vad
     ZF_LOGD("as_shrink_region: [%p-%p] -> [%p-%p]", reg->vbase, reg->vbase + reg->memsize, vaddr, sz);
     assert(vaddr >= reg->vbase);
     assert(vaddr + sz <= reg->vbase + reg->memsize);
+    as->gen++;
     if (sz == 0) {
         as_destroy_region(as, cspace, reg, unallocate, me);
         return;
     }
     if (unallocate) {
-        for (vaddr_t curr = reg->vbase; curr < vaddr; curr += PAGE_SIZE_4K) {
-            unalloc_frame(as, cspace, curr, me);
-        }
-        for (vaddr_t curr = vaddr + sz; curr < reg->vbase + reg->memsize; curr += PAGE_SIZE_4K) {
-            unalloc_frame(as, cspace, curr, me);
-        }
+        unalloc_range(as, cspace, reg->vbase, vaddr, me);
+        unalloc_range(as, cspace, vaddr + sz, VEND(reg), me);
     }
     reg->vbase = vaddr;
     reg->memsize = sz;
+    as_region_resized(as, reg);
 }
@@ -21,15 +21,24 @@ typedef struct region {
     struct region *next;
     size_t memsize;
     bool mmaped;
+    /* AVL tree keyed by vbase, augmented with the free gaps between regions */
+    struct region *left;
+    struct region *right;
+    struct region *parent;
+    int height;
+    size_t gap;             /* free space between the previous region and vbase */
+    size_t max_gap;         /* largest gap in this subtree */
 } region_t;
 
 typedef struct addrspace {
-    struct region *regions;
+    struct region *regions;     /* sorted list, for walking neighbours */
+    struct region *region_root; /* the same regions as a tree, for lookups */
     struct region *stack;
     struct region *heap;
     frame_ref_t pagetable;
     seL4_CPtr vspace;
     size_t pagecount;
+    unsigned long gen;      /* bumped whenever a region goes away, see user_cursor_t */
 } addrspace_t;
 
 addrspace_t *as_create(seL4_CPtr vspace, coro_t coro);
@@ -41,20 +50,22 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 void as_destroy_region(struct addrspace *as, cspace_t *cspace, region_t *reg, bool unallocate, coro_t me);
 void as_shrink_region(struct addrspace *as, cspace_t *cspace, region_t *reg, vaddr_t vaddr, size_t sz, bool unallocate, coro_t me);
 
-static inline region_t *get_last_region(region_t *rg, vaddr_t vaddr) {
-    region_t *lst = NULL;
-    while(rg != NULL && rg->vbase <= vaddr) {
-        lst = rg;
-        rg = rg->next;
-    }
-    return lst;
-}
+/*
+ * Must be called after changing the vbase or memsize of reg in place (brk,
+ * stack growth). The new bounds must not cross its neighbours.
+ */
+void as_region_resized(struct addrspace *as, region_t *reg);
 
-static inline region_t *get_region(region_t *rg, vaddr_t vaddr) {
-    region_t *ret = get_last_region(rg, vaddr);
-    if (ret != NULL && VEND(ret) > vaddr) return ret;
-    return NULL;
-}
+/* last region starting at or below vaddr */
+region_t *get_last_region(addrspace_t *as, vaddr_t vaddr);
+/* region containing vaddr */
+region_t *get_region(addrspace_t *as, vaddr_t vaddr);
+
+/*
+ * Lowest page aligned address at or above base with sz bytes free, or 0
+ * if there is none below top.
+ */
+vaddr_t as_find_free(addrspace_t *as, vaddr_t base, vaddr_t top, size_t sz);
 
 static inline region_t *get_region_with_possible_stack_extension(addrspace_t *as, vaddr_t vaddr) {
     assert(as->stack->prev != NULL);
@@ -62,7 +73,8 @@ static inline region_t *get_region_with_possible_stack_extension(addrspace_t *as
     if (VEND(as->stack->prev) <= aligned && aligned < as->stack->vbase) {
         as->stack->memsize += as->stack->vbase - aligned;
         as->stack->vbase = aligned;
+        as_region_resized(as, as->stack);
         return as->stack;
     }
-    return get_region(as->regions, vaddr);
+    return get_region(as, vaddr);
 }
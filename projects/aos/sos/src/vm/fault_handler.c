@@ -1,4 +1,6 @@
 #include "fault_handler.h"
+#include "../coroutine/sched.h"
+#include "../utils.h"
 
 
 // this is from the CPU doc armv8 
@@ -13,11 +15,18 @@ static inline bool is_perm_fault(seL4_Word fsr) {
     return (fsr & 0b01111) == 0b01111;
 }
 
-static void clean_up(cspace_t *cspace, seL4_CPtr reply, ut_t *reply_ut, bool sendreply) {
+/* The coroutine handle_vm_fault is currently running for the first time.
+ * If it resolves the fault without yielding the syscall loop replies. */
+static coro_t inline_coro;
+static bool inline_replied;
+
+static void clean_up(seL4_CPtr reply, ut_t *reply_ut, bool sendreply, coro_t coro) {
+    if (sendreply && inline_coro == coro) {
+        inline_replied = true;
+        return;
+    }
     if (sendreply) seL4_Send(reply, seL4_MessageInfo_new(0, 0, 0, 0));
-    cspace_delete(cspace, reply);
-    cspace_free_slot(cspace, reply);
-    ut_free(reply_ut);
+    reply_free(reply, reply_ut);
 }
 
 struct vm_fault_handler_args {
@@ -44,7 +53,7 @@ bool ensure_mapping(cspace_t *cspace, void *vaddr, process_t *proc, addrspace_t
 
     vaddr = PAGE_ALIGN_4K((vaddr_t) vaddr);
 
-    pte_t *pte = get_pte(as, (vaddr_t) vaddr, false, NULL);
+    pte_t *pte = get_pte(as, (vaddr_t) vaddr, false, coro);
 
     if (pte == NULL) {
         /* Alloc frame */
@@ -64,28 +73,28 @@ bool ensure_mapping(cspace_t *cspace, void *vaddr, process_t *proc, addrspace_t
             }
             break;
             case PAGING_OUT:
-            proc->paging_coro = coro;
-            pte->frame = currproc->pid;
-            yield(NULL);
-            proc->paging_coro = NULL;
+            paging_wait(pte, coro);
             // i think we can directly fallthrough to PAGED_OUT case here
             // but to be on the safe side, we check everything again :)
             return ensure_mapping(cspace, vaddr, proc, as, coro, mapped_region, mapped_pte);
             case PAGED_OUT:;
             size_t pfidx = pte->frame;
-            seL4_Error err = alloc_map_frame(as, cspace, (vaddr_t) vaddr, region->rights, region->attrs, NULL, coro, false);
+            /* allocating the frame may page out, keep our page table in */
+            pte_hold(pte);
+            err = alloc_map_frame(as, cspace, (vaddr_t) vaddr, region->rights, region->attrs, NULL, coro, false);
             if (err != seL4_NoError) {
                 ZF_LOGE("Failed to map new frame");
-                return false;
             } else {
                 err = page_in(pte->frame, pfidx, coro);
                 if (err != seL4_NoError) {
                     ZF_LOGE("Failed to pagein");
-                    return false;
+                } else {
+                    pte->type = IN_MEM;
+                    set_frame_pte(pte->frame, pte);
                 }
-                pte->type = IN_MEM;
-                set_frame_pte(pte->frame, pte);
             }
+            pte_release(pte);
+            if (err != seL4_NoError) return false;
             break;
             case DEVICE:
             err = app_map_device(cspace, as, vaddr, pte, coro);
@@ -124,19 +133,26 @@ void *_handle_vm_fault_impl(void *args) {
     }
 
     if (kill || curr->state == PROC_TO_BE_KILLED) {
-        clean_up(cspace, reply, reply_ut, false);
+        clean_up(reply, reply_ut, false, coro);
         kill_process(curr, coro);
     } else {
-        clean_up(cspace, reply, reply_ut, true);
+        clean_up(reply, reply_ut, true, coro);
         curr->state = PROC_RUNNING;
     }
 
     return NULL;
 }
 
-void handle_vm_fault(cspace_t *cspace, void *vaddr, seL4_Word type, process_t *curr, seL4_CPtr reply, ut_t *reply_ut) {
-    curr->state = PROC_BLOCKED;
+bool handle_vm_fault(cspace_t *cspace, void *vaddr, seL4_Word type, process_t *curr, seL4_CPtr reply, ut_t *reply_ut) {
     coro_t c = coroutine(_handle_vm_fault_impl);
+    if (c == NULL) {
+        /* reply without mapping anything, the thread faults again and we
+         * retry once some memory has been freed */
+        ZF_LOGE("No coroutine to handle vm fault of %s (%d)", curr->command, curr->pid);
+        return true;
+    }
+    curr->state = PROC_BLOCKED;
+    set_coro_prio(c, SCHED_FAULT);
     struct vm_fault_handler_args args = {
         .cspace = cspace,
         .vaddr = vaddr,
@@ -146,7 +162,11 @@ void handle_vm_fault(cspace_t *cspace, void *vaddr, seL4_Word type, process_t *c
         .reply_ut = reply_ut,
         .coro = c
     };
+    inline_coro = c;
+    inline_replied = false;
     resume(c, &args);
+    inline_coro = NULL;
+    return inline_replied;
 }
 
 struct handle_fault_kill_args {
@@ -161,12 +181,33 @@ void *_handle_fault_kill(void *data) {
     kill_process(proc, coro);
 }
 
+/* processes that faulted fatally while no coroutine could be had */
+static process_t *kill_pending;
+
 void handle_fault_kill(process_t *proc) {
     proc->state = PROC_TO_BE_KILLED;
     coro_t c = coroutine(_handle_fault_kill);
+    if (c == NULL) {
+        ZF_LOGE("No coroutine to kill %s (%d), retrying later", proc->command, proc->pid);
+        seL4_TCB_Suspend(proc->tcb);
+        proc->kill_next = kill_pending;
+        kill_pending = proc;
+        return;
+    }
+    set_coro_prio(c, SCHED_BACKGROUND);
     struct handle_fault_kill_args args = {
         .proc = proc,
         .coro = c,
     };
     resume(c, &args);
 }
+
+void retry_fault_kills(void) {
+    process_t *proc = kill_pending;
+    kill_pending = NULL;
+    while (proc != NULL) {
+        process_t *next = proc->kill_next;
+        handle_fault_kill(proc);
+        proc = next;
+    }
+}
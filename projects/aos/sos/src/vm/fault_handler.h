@@ -8,5 +8,16 @@
 #include <sel4/sel4.h>
 
 bool ensure_mapping(cspace_t *cspace, void *vaddr, process_t *proc, addrspace_t *as, coro_t coro, region_t **mapped_region, pte_t **mapped_pte);
-void handle_vm_fault(cspace_t *cspace, void *vaddr, seL4_Word type, process_t *curr, seL4_CPtr reply, ut_t *reply_ut);
+/*
+ * Resolve a vm fault in a new coroutine, which owns reply/reply_ut unless
+ * the fault is resolved without blocking. Then this returns true and the
+ * caller keeps the reply object and must send the (empty) reply itself.
+ */
+bool handle_vm_fault(cspace_t *cspace, void *vaddr, seL4_Word type, process_t *curr, seL4_CPtr reply, ut_t *reply_ut);
+/*
+ * Kill a process after a fault SOS cannot resolve. If no coroutine is
+ * available the process is suspended and the kill is retried by
+ * retry_fault_kills.
+ */
 void handle_fault_kill(process_t *proc);
+void retry_fault_kills(void);
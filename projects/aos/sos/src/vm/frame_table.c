@@ -15,6 +15,7 @@
 #include "pagetable.h"
 #include "../vfs/vfs.h"
 #include "../process.h"
+#include "../coroutine/sched.h"
 
 #include <assert.h>
 #include <fcntl.h>
@@ -131,6 +132,7 @@ void pager_init(void (*cb)()) {
     memset(pageused, 0, sizeof(pageused));
     last_page = 0;
     coro_t coro = coroutine(pager_open);
+    ZF_LOGF_IF(coro == NULL, "No coroutine to open the pagefile");
     resume(coro, coro);
 }
 
@@ -146,7 +148,18 @@ static frame_ref_t find_victim() {
     bool has_unpinned = false;
     frame_t *frame = pop_front(&frame_table.allocated);
     do {
-       if (!frame->pin) {
+       if (frame->pt) {
+           /* page tables only go once nothing in them is resident; their
+            * ref bit is set by page table walks instead of by faults */
+           if (!frame->pin && pt_evictable(ref_from_frame(frame))) {
+               has_unpinned = true;
+               if (!frame->ref) {
+                   push_back(&frame_table.allocated, frame);
+                   return ref_from_frame(frame);
+               }
+               frame->ref = 0;
+           }
+       } else if (!frame->pin) {
            // printf("find_victim %d %d %p\n", ref_from_frame(frame), frame->ref, frame);
            has_unpinned = true;
            if (!frame->ref) {
@@ -186,6 +199,21 @@ frame_ref_t alloc_frame(coro_t coro) {
     return victim;
 }
 
+frame_ref_t alloc_sos_frame(void) {
+    frame_t *frame = pop_front(&frame_table.free);
+
+    if (frame == NULL) {
+        frame = alloc_fresh_frame();
+        if (frame == NULL) return NULL_FRAME;
+    }
+
+    frame->pin = 1;
+    frame->ref = 0;
+    frame->pte = NULL;
+    push_back(&frame_table.allocated, frame);
+    return ref_from_frame(frame);
+}
+
 // written by kernel engineer
 // it uses bitwise calculation so it must be correct
 static inline int pf_getidx() {
@@ -215,6 +243,76 @@ void pf_setfree(int pfidx) {
     pageused[pfidx >> 3] &= ~(1 << (pfidx & 7));
 }
 
+/* A coroutine blocked in paging_wait, on its own stack */
+struct paging_waiter {
+    void *entry;
+    coro_t coro;
+    struct paging_waiter *next;
+};
+
+static struct paging_waiter *paging_waiters;
+
+void paging_wait(void *entry, coro_t coro) {
+    assert(coro != NULL);
+    struct paging_waiter waiter = {
+        .entry = entry,
+        .coro = coro,
+        .next = paging_waiters,
+    };
+    paging_waiters = &waiter;
+    yield(NULL);
+}
+
+void paging_wake(void *entry) {
+    struct paging_waiter **prev = &paging_waiters;
+    while (*prev != NULL) {
+        struct paging_waiter *waiter = *prev;
+        if (waiter->entry == entry) {
+            *prev = waiter->next;
+            sched_wake(waiter->coro, NULL);
+        } else {
+            prev = &waiter->next;
+        }
+    }
+}
+
+/*
+ * Page out a leaf page table picked by find_victim. Walkers that reach its
+ * pde while this runs wait for "paging" to clear and then page it back in.
+ */
+static int page_out_pt(frame_ref_t frame_ref, int pfidx, coro_t coro) {
+    frame_t *frame = frame_from_ref(frame_ref);
+    pde_t *pde = (pde_t *) frame->pte;
+    ZF_LOGD("page out page table %d to pf %d", frame_ref, pfidx);
+
+    pt_evicting(frame_ref);
+    pde->paging = true;
+
+    uio_t myuio;
+
+    uio_kinit(&myuio, frame_data(frame_ref), PAGE_SIZE_4K, pfidx * PAGE_SIZE_4K, UIO_READ);
+    if (VOP_PWRITE(pf_vnode, &myuio, coro) != PAGE_SIZE_4K) {
+        ZF_LOGE("page_out: VOP_PWRITE not entire page table");
+        pde->paging = false;
+        paging_wake(pde);
+        frame->pin = 0;
+        pf_setfree(pfidx);
+        return 1;
+    }
+
+    pde->frame = pfidx;
+    pde->paged_out = true;
+    pde->paging = false;
+    paging_wake(pde);
+
+    frame->pin = 0;
+    frame->pt = 0;
+    frame->ref = 0;
+    frame->pte = NULL;
+
+    return 0;
+}
+
 int page_out(frame_ref_t frame_ref, coro_t coro) {
     frame_t *frame = frame_from_ref(frame_ref);
     frame->pin = 1;
@@ -224,22 +322,16 @@ int page_out(frame_ref_t frame_ref, coro_t coro) {
         ZF_LOGE("pagefile is full");
         return 1;
     }
+    if (frame->pt) return page_out_pt(frame_ref, pfidx, coro);
     ZF_LOGD("page out %d to pf %d", frame_ref, pfidx);
 
     cspace_delete(frame_table.cspace, frame->pte->cap);
     cspace_free_slot(frame_table.cspace, frame->pte->cap);
     frame->pte->cap = seL4_CapNull;
 
+    /* anyone touching the page until the write lands waits in paging_wait */
     frame->pte->type = PAGING_OUT;
 
-    // we temporarily reset this to 0
-    // if the process tries to page it in when it's paged out, it writes its
-    // pid to frame and yield.
-    // this way we know who to wake up after we finish paging out for them to
-    // page it in again.
-    // we use pid because we don't have enough bits for a coroutine pointer
-    frame->pte->frame = 0;
-
     uio_t myuio;
 
     uio_kinit(&myuio, frame_data(frame_ref), PAGE_SIZE_4K, pfidx * PAGE_SIZE_4K, UIO_READ);
@@ -249,15 +341,9 @@ int page_out(frame_ref_t frame_ref, coro_t coro) {
     }
 
     frame->pte->type = PAGED_OUT;
-    if (frame->pte->frame) {
-        pid_t pid = frame->pte->frame;
-        frame->pte->frame = pfidx;
-        process_t *proc = get_process_by_pid(pid);
-        if (proc && proc->paging_coro) resume(proc->paging_coro, NULL);
-    } else {
-        frame->pte->frame = pfidx;
-    }
-    
+    frame->pte->frame = pfidx;
+    paging_wake(frame->pte);
+
     frame->pin = 0;
 
     frame->ref = 0;
@@ -293,6 +379,11 @@ void free_frame(frame_ref_t frame_ref)
     if (frame_ref != NULL_FRAME) {
         frame_t *frame = frame_from_ref(frame_ref);
 
+        /* don't let the next owner inherit a pin or a dangling pte */
+        frame->pin = 0;
+        frame->pt = 0;
+        frame->ref = 0;
+        frame->pte = NULL;
         remove_frame(&frame_table.allocated, frame);
         push_front(&frame_table.free, frame);
     }
@@ -341,6 +432,13 @@ void set_frame_pte(frame_ref_t frame_ref, pte_t *pte) {
     frame->ref = 1;
 }
 
+void set_frame_pt(frame_ref_t frame_ref, pde_t *pde) {
+    frame_t *frame = frame_from_ref(frame_ref);
+    frame->pt = 1;
+    frame->pte = (pte_t *) pde;
+    frame->ref = 1;
+}
+
 frame_t *frame_from_ref(frame_ref_t frame_ref)
 {
     assert(frame_ref != NULL_FRAME);
@@ -78,6 +78,8 @@ PACKED struct frame {
     bool ref : 1;
     /* don't evict */
     bool pin : 1;
+    /* holds a leaf page table, pte is really the pde pointing at it */
+    bool pt : 1;
     /* pointer back to pte */
     struct pte *pte;
 };
@@ -121,11 +123,21 @@ cspace_t *frame_table_cspace(void);
  */
 frame_ref_t alloc_frame(coro_t coro);
 
+/*
+ * Allocate a pinned frame for SOS's own use (e.g. coroutine stacks).
+ *
+ * Unlike alloc_frame this never pages anything out, so it may be called
+ * outside of a coroutine. Returns NULL_FRAME if there is no free frame and
+ * the table cannot grow.
+ */
+frame_ref_t alloc_sos_frame(void);
+
 /*
  * Free a frame allocated by the frame table.
  *
  * This returns the frame to the frame table for re-use rather than
- * returning it to the untyped allocator.
+ * returning it to the untyped allocator. The frame comes back unpinned
+ * and without a pte, whatever state it was freed in.
  */
 void free_frame(frame_ref_t frame_ref);
 
@@ -158,6 +170,8 @@ void invalidate_frame(frame_ref_t frame_ref);
 void pin_frame(frame_ref_t frame_ref);
 void unpin_frame(frame_ref_t frame_ref);
 void set_frame_pte(frame_ref_t frame_ref, pte_t *pte);
+/* Mark frame as holding the leaf page table that pde points to */
+void set_frame_pt(frame_ref_t frame_ref, pde_t *pde);
 
 /*
  * Get the capability to the page used to map the frame into SOS.
@@ -177,4 +191,13 @@ frame_t *frame_from_ref(frame_ref_t frame_ref);
 int page_out(frame_ref_t frame_ref, coro_t coro);
 int page_in(frame_ref_t ref, size_t pfidx, coro_t coro);
 void pf_setfree(int pfidx);
+
+/*
+ * Wait until the pte or pde at entry is no longer being paged out (or, for
+ * a pde, paged back in). The coroutine is queued on entry and woken by the
+ * paging_wake call that finishes the transfer.
+ */
+void paging_wait(void *entry, coro_t coro);
+/* Wake everything waiting in paging_wait on entry. */
+void paging_wake(void *entry);
 void pager_init(void (*cb)());
@@ -4,7 +4,9 @@
 #include "frame_table.h"
 #include "../vmem_layout.h"
 #include "../mapping.h"
+#include "../coroutine/sched.h"
 
+#include <errno.h>
 #include <sel4/sel4.h>
 #include <sel4/sel4_arch/mapping.h>
 
@@ -21,18 +23,30 @@ typedef seL4_Error (*pt_unmapper)(seL4_CPtr);
 static pt_mapper pt_level2mapper[3] = {seL4_ARM_PageTable_Map, seL4_ARM_PageDirectory_Map, seL4_ARM_PageUpperDirectory_Map};
 static pt_unmapper pt_level2unmapper[3] = {seL4_ARM_PageTable_Unmap, seL4_ARM_PageDirectory_Unmap, seL4_ARM_PageUpperDirectory_Unmap};
 
+/* bytes of address space covered by one leaf page table */
+#define LEAF_SPAN BIT(PTE_BITS + PAGE_TABLE_LEVEL_BITS)
+
 static inline seL4_Word get_vaddr_level_idx(vaddr_t addr, int level) {
     return (addr >> level_to_offset[level]) & PAGE_TABLE_LEVEL_MASK;
 }
 
+/*
+ * Table bookkeeping is spread over the reserved low 16 bits of the entries,
+ * four entries per word.
+ */
+#define PT_CAP_WORD     0
+#define PT_UT_WORD      4
+#define PT_BUSY_WORD    8   /* holders of a leaf table, see pte_hold */
+#define PT_OWNER_WORD   12  /* addrspace_t of a leaf table */
+
 static inline void setWord(page_table_t *pt, seL4_Word word, int off) {
-    pt->entries[off] &= 0xFFFFFFFFFF0000;
+    pt->entries[off] &= 0xFFFFFFFFFFFF0000;
     pt->entries[off++] |= word >> 48;
-    pt->entries[off] &= 0xFFFFFFFFFF0000;
+    pt->entries[off] &= 0xFFFFFFFFFFFF0000;
     pt->entries[off++] |= (word & 0x0000FFFF00000000) >> 32;
-    pt->entries[off] &= 0xFFFFFFFFFF0000;
+    pt->entries[off] &= 0xFFFFFFFFFFFF0000;
     pt->entries[off++] |= (word & 0x00000000FFFF0000) >> 16;
-    pt->entries[off] &= 0xFFFFFFFFFF0000;
+    pt->entries[off] &= 0xFFFFFFFFFFFF0000;
     pt->entries[off] |= (word & 0x000000000000FFFF);
 }
 
@@ -44,47 +58,138 @@ static inline seL4_Word getWord(page_table_t *pt, int off) {
 }
 
 static inline void setCap(page_table_t *pt, seL4_CPtr cap) {
-    setWord(pt, (seL4_Word) cap, 0);
+    setWord(pt, (seL4_Word) cap, PT_CAP_WORD);
 }
 static inline seL4_CPtr getCap(page_table_t *pt) {
-    return (seL4_CPtr) getWord(pt, 0);
+    return (seL4_CPtr) getWord(pt, PT_CAP_WORD);
 }
 
 static inline void setUt(page_table_t *pt, ut_t *ut) {
-    setWord(pt, (seL4_Word) ut, 4);
+    setWord(pt, (seL4_Word) ut, PT_UT_WORD);
 }
 static inline ut_t *getUt(page_table_t *pt) {
-    return (ut_t *) getWord(pt, 4);
+    return (ut_t *) getWord(pt, PT_UT_WORD);
+}
+
+static inline seL4_Word getBusy(page_table_t *pt) {
+    return getWord(pt, PT_BUSY_WORD);
+}
+static inline void addBusy(page_table_t *pt, long delta) {
+    assert(delta > 0 || getBusy(pt) > 0);
+    setWord(pt, getBusy(pt) + delta, PT_BUSY_WORD);
 }
 
-seL4_Error create_pt(pde_t *entry, coro_t coro) {
+static inline page_table_t *pte_table(pte_t *pte) {
+    return (page_table_t *) ROUND_DOWN((uintptr_t) pte, PAGE_SIZE_4K);
+}
+
+/*
+ * Create the level "level" table for entry. Leaf tables are left unpinned
+ * and may be paged out later, the rest are pinned for good.
+ */
+seL4_Error create_pt(addrspace_t *as, pde_t *entry, int level, coro_t coro) {
     frame_ref_t frame = alloc_frame(coro);
     if (frame == NULL_FRAME) {
         ZF_LOGE("Couldn't allocate additional stack frame");
         return seL4_NotEnoughMemory;
     }
-    pin_frame(frame);
+    if (entry->inuse) {
+        /* someone else filled it in while we were allocating */
+        free_frame(frame);
+        return seL4_NoError;
+    }
     memset(frame_data(frame), 0, PAGE_SIZE_4K);
     entry->inuse = true;
+    entry->paged_out = false;
+    entry->paging = false;
     entry->frame = frame;
+    if (level == 0) {
+        setWord(frame_data(frame), (seL4_Word) as, PT_OWNER_WORD);
+        set_frame_pt(frame, entry);
+    } else {
+        pin_frame(frame);
+    }
     return seL4_NoError;
 }
 
+/* Bring the leaf table of entry back from the pagefile. */
+static int pt_page_in(pde_t *entry, coro_t coro) {
+    size_t pfidx = entry->frame;
+    entry->paging = true;
+    frame_ref_t frame = alloc_frame(coro);
+    if (frame == NULL_FRAME || page_in(frame, pfidx, coro)) {
+        ZF_LOGE("Failed to page in page table");
+        free_frame(frame);
+        entry->paging = false;
+        paging_wake(entry);
+        return -1;
+    }
+    entry->frame = frame;
+    entry->paged_out = false;
+    entry->paging = false;
+    paging_wake(entry);
+    set_frame_pt(frame, entry);
+    return 0;
+}
+
+/*
+ * The table that entry points to, paged back in if needed. Returns NULL if
+ * it is gone, or not resident and coro is NULL so we can't wait for it.
+ */
+static page_table_t *pde_table(pde_t *entry, coro_t coro) {
+    while (entry->inuse && (entry->paging || entry->paged_out)) {
+        if (coro == NULL) return NULL;
+        if (entry->paging) {
+            /* on its way out or in, wait until it's done */
+            paging_wait(entry, coro);
+        } else if (pt_page_in(entry, coro)) {
+            return NULL;
+        }
+    }
+    if (!entry->inuse) return NULL;
+    frame_from_ref(entry->frame)->ref = 1;
+    return (page_table_t *) frame_data(entry->frame);
+}
+
 static page_table_t *get_pt_level(addrspace_t *as, vaddr_t addr, int level, bool create, coro_t coro) {
     page_table_t *pt = frame_data(as->pagetable);
-    for (int i = PAGE_TABLE_LEVELS - 2; i >= level; i--) {
+    for (int i = PAGE_TABLE_LEVELS - 1; i >= level; i--) {
         seL4_Word idx = get_vaddr_level_idx(addr, i);
         pde_t *entry = (pde_t *) (pt->entries + idx);
         if (!entry->inuse) {
             if (!create) return NULL;
-            if (create_pt(entry, coro) != seL4_NoError) return NULL;
+            if (create_pt(as, entry, i - 1, coro) != seL4_NoError) return NULL;
         }
-        assert(entry->inuse);
-        pt = frame_data(entry->frame);
+        pt = pde_table(entry, coro);
+        if (pt == NULL) return NULL;
     }
     return pt;
 }
 
+void pte_hold(pte_t *pte) {
+    addBusy(pte_table(pte), 1);
+}
+
+void pte_release(pte_t *pte) {
+    addBusy(pte_table(pte), -1);
+}
+
+bool pt_evictable(frame_ref_t frame) {
+    page_table_t *pt = (page_table_t *) frame_data(frame);
+    if (getBusy(pt) != 0) return false;
+    for (int i = 0; i < PAGE_TABLE_LEVEL_SIZE; i++) {
+        pte_t *pte = (pte_t *) (pt->entries + i);
+        if (pte->inuse && pte->type != PAGED_OUT) return false;
+    }
+    return true;
+}
+
+void pt_evicting(frame_ref_t frame) {
+    addrspace_t *as = (addrspace_t *) getWord((page_table_t *) frame_data(frame), PT_OWNER_WORD);
+    /* drop cursors caching the table */
+    as->gen++;
+}
+
 static seL4_Error retype_pt(cspace_t *cspace, seL4_CPtr vspace, seL4_Word vaddr, seL4_CPtr ut, seL4_CPtr empty, int level) {
     seL4_Error err = cspace_untyped_retype(cspace, ut, empty, pt_level2type[level], seL4_PageBits);
     if (err) return err;
@@ -134,7 +239,8 @@ static seL4_Error map_frame_impl(addrspace_t *as, cspace_t *cspace, seL4_CPtr fr
 
         err = retype_pt(cspace, as->vspace, vaddr, ut->cap, slot, level);
         if (!err) {
-            page_table_t *pt = get_pt_level(as, vaddr, level, true, coro);
+            /* the shadow of a level n object is the table looked up at level n + 1 */
+            page_table_t *pt = get_pt_level(as, vaddr, level + 1, true, coro);
             if (pt == NULL) {
                 err = seL4_NotEnoughMemory;
             } else {
@@ -246,12 +352,10 @@ static inline void unalloc_frame_impl(addrspace_t *as, pte_t *pte, cspace_t *csp
             break;
 
             case PAGING_OUT:
-            currproc->paging_coro = coro;
-            pte->frame = currproc->pid;
-            printf("paging out yield\n");
-            yield(NULL);
-            printf("paging out resume\n");
-            currproc->paging_coro = NULL;
+            /* page_out is still writing this frame, wait until it lands */
+            pte_hold(pte);
+            while (pte->type == PAGING_OUT) paging_wait(pte, coro);
+            pte_release(pte);
             // i think we can directly fallthrough to PAGED_OUT case here
             // but to be on the safe side, we check everything again :)
             unalloc_frame_impl(as, pte, cspace, coro);
@@ -266,27 +370,20 @@ static inline void unalloc_frame_impl(addrspace_t *as, pte_t *pte, cspace_t *csp
             break;
 
             case DEVICE:;
-            /* unmap our pte */
+            /* unmap our pte and drop our copy of the device cap */
             assert(seL4_ARM_Page_Unmap(pte->cap) == seL4_NoError);
             pte->mapped = false;
+            err = cspace_delete(cspace, pte->cap);
+            assert(err == seL4_NoError);
+            cspace_free_slot(cspace, pte->cap);
         }
         pte->inuse = false;
         as->pagecount--;
     }
 }
 
-static void pagetable_destroy_impl(addrspace_t *as, page_table_t *pt, cspace_t *cspace, int level, coro_t coro) {
-    for (int i = 0; i < PAGE_TABLE_LEVEL_SIZE; i++) {
-        if (level == 0) {
-            unalloc_frame_impl(as, pt->entries + i, cspace, coro);
-        } else {
-            pde_t *entry = (pde_t *) (pt->entries + i);
-            if (entry->inuse) {
-                pagetable_destroy_impl(as, frame_data(entry->frame), cspace, level - 1, coro);
-                free_frame(entry->frame);
-            }
-        }
-    }
+/* Delete the seL4 paging object that pt shadows, if it has one. */
+static void release_pt(cspace_t *cspace, page_table_t *pt, int level) {
     seL4_CPtr cap = getCap(pt);
     if (cap != seL4_CapNull) {
         pt_level2unmapper[level](cap);
@@ -298,25 +395,151 @@ static void pagetable_destroy_impl(addrspace_t *as, page_table_t *pt, cspace_t *
     }
 }
 
+static void pagetable_destroy_impl(addrspace_t *as, page_table_t *pt, cspace_t *cspace, int level, coro_t coro) {
+    if (level == 0) addBusy(pt, 1);
+    for (int i = 0; i < PAGE_TABLE_LEVEL_SIZE; i++) {
+        if (level == 0) {
+            unalloc_frame_impl(as, pt->entries + i, cspace, coro);
+            sched_yield_point(coro);
+        } else {
+            pde_t *entry = (pde_t *) (pt->entries + i);
+            if (!entry->inuse) continue;
+            /* paged out tables come back in, their pages hold pagefile slots */
+            page_table_t *child = pde_table(entry, coro);
+            if (child == NULL) {
+                ZF_LOGE("Leaking paged out page table");
+                continue;
+            }
+            pagetable_destroy_impl(as, child, cspace, level - 1, coro);
+            free_frame(entry->frame);
+        }
+    }
+    if (level == 0) addBusy(pt, -1);
+    release_pt(cspace, pt, level);
+}
+
 void pagetable_destroy(addrspace_t *as, cspace_t *cspace, coro_t coro) {
-    pagetable_destroy_impl(as, frame_data(as->pagetable), cspace, PAGE_TABLE_LEVELS - 2, coro);
+    pagetable_destroy_impl(as, frame_data(as->pagetable), cspace, PAGE_TABLE_LEVELS - 1, coro);
     free_frame(as->pagetable);
 }
 
 
 void unalloc_frame(addrspace_t *as, cspace_t *cspace, vaddr_t vaddr, coro_t coro) {
-    // give null coro since not create pte
-    unalloc_frame_impl(as, get_pte(as, vaddr, false, NULL), cspace, coro);
+    unalloc_frame_impl(as, get_pte(as, vaddr, false, coro), cspace, coro);
 }
 
-void *map_vaddr_to_sos(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, pte_t *ppte, size_t *size, coro_t coro) {
-    vaddr_t vbase = PAGE_ALIGN_4K(vaddr);
-    size_t offset = vaddr - vbase;
-    pte_t *pte = get_pte(as, vbase, true, coro);
-    if (pte == NULL) {
-        ZF_LOGE("pte is null");
-        return NULL;
+/* true if nothing is left in pt and nobody holds it */
+static bool pt_empty(page_table_t *pt) {
+    if (getBusy(pt) != 0) return false;
+    for (int i = 0; i < PAGE_TABLE_LEVEL_SIZE; i++) {
+        if (((pde_t *) (pt->entries + i))->inuse) return false;
+    }
+    return true;
+}
+
+/* true if pte is user memory that nothing but the process relies on */
+static bool pte_discardable(pte_t *pte) {
+    if (!pte->inuse) return false;
+    switch (pte->type) {
+        case IN_MEM:
+        return !frame_from_ref(pte->frame)->pin;
+        case PAGING_OUT:
+        case PAGED_OUT:
+        return true;
+        default:
+        return false;
+    }
+}
+
+/*
+ * Unmap [vaddr, end), stopping at the end of the leaf table holding vaddr,
+ * then free the tables on the way back up that have become empty. Walks
+ * from the root every time and returns where to carry on from, which skips
+ * a whole missing subtree at once. With discard set, pages that fail
+ * pte_discardable are left alone.
+ *
+ * The leaf is held while we yield, which also keeps every table above it
+ * non-empty, so none of them can be paged out or freed under us.
+ */
+static vaddr_t unalloc_leaf(addrspace_t *as, cspace_t *cspace, vaddr_t vaddr, vaddr_t end, bool discard,
+                            coro_t coro) {
+    pde_t *path[PAGE_TABLE_LEVELS];
+    page_table_t *pt = frame_data(as->pagetable);
+    for (int level = PAGE_TABLE_LEVELS - 1; level > 0; level--) {
+        pde_t *entry = (pde_t *) (pt->entries + get_vaddr_level_idx(vaddr, level));
+        page_table_t *child = entry->inuse ? pde_table(entry, coro) : NULL;
+        if (child == NULL) {
+            if (entry->inuse) ZF_LOGE("Leaking paged out page table");
+            vaddr_t next = ROUND_DOWN(vaddr, BIT(level_to_offset[level])) + BIT(level_to_offset[level]);
+            return next > end || next < vaddr ? end : next;
+        }
+        path[level] = entry;
+        pt = child;
+    }
+
+    vaddr_t stop = MIN(end, ROUND_DOWN(vaddr, LEAF_SPAN) + LEAF_SPAN);
+    addBusy(pt, 1);
+    for (; vaddr < stop; vaddr += PAGE_SIZE_4K) {
+        pte_t *pte = (pte_t *) (pt->entries + get_vaddr_level_idx(vaddr, 0));
+        if (!discard || pte_discardable(pte)) unalloc_frame_impl(as, pte, cspace, coro);
+        sched_yield_point(coro);
+    }
+    addBusy(pt, -1);
+
+    for (int level = 1; level < PAGE_TABLE_LEVELS; level++) {
+        if (!pt_empty(pt)) break;
+        pde_t *entry = path[level];
+        release_pt(cspace, pt, level - 1);
+        free_frame(entry->frame);
+        entry->inuse = false;
+        as->gen++;
+        if (level + 1 < PAGE_TABLE_LEVELS) pt = frame_data(path[level + 1]->frame);
+    }
+    return stop;
+}
+
+void unalloc_range(addrspace_t *as, cspace_t *cspace, vaddr_t start, vaddr_t end, coro_t coro) {
+    vaddr_t vaddr = PAGE_ALIGN_4K(start);
+    while (vaddr < end) {
+        vaddr = unalloc_leaf(as, cspace, vaddr, end, false, coro);
+    }
+}
+
+void discard_range(addrspace_t *as, cspace_t *cspace, vaddr_t start, vaddr_t end, coro_t coro) {
+    vaddr_t vaddr = PAGE_ALIGN_4K(start);
+    while (vaddr < end) {
+        vaddr = unalloc_leaf(as, cspace, vaddr, end, true, coro);
     }
+}
+
+int prefault_range(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t start, vaddr_t end, bool all, coro_t coro) {
+    vaddr_t vaddr = PAGE_ALIGN_4K(start);
+    while (vaddr < end) {
+        page_table_t *leaf = get_pt_level(as, vaddr, 1, false, coro);
+        if (leaf == NULL && !all) {
+            /* nothing was ever touched here, nothing to bring back */
+            vaddr = ROUND_DOWN(vaddr, LEAF_SPAN) + LEAF_SPAN;
+            continue;
+        }
+
+        pte_t *pte = leaf ? (pte_t *) (leaf->entries + get_vaddr_level_idx(vaddr, 0)) : NULL;
+        bool want;
+        if (pte == NULL || !pte->inuse) {
+            want = all;
+        } else if (pte->type == IN_MEM) {
+            want = all && !pte->mapped;
+        } else {
+            want = pte->type == PAGED_OUT || pte->type == PAGING_OUT;
+        }
+        if (want && !ensure_mapping(cspace, (void *) vaddr, proc, as, coro, NULL, NULL)) return -ENOMEM;
+        sched_yield_point(coro);
+        vaddr += PAGE_SIZE_4K;
+    }
+    return 0;
+}
+
+/* Make the page of pte resident and return its data in SOS */
+static void *map_pte_to_sos(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, pte_t *pte, coro_t coro) {
     if (!pte->inuse) {
         frame_ref_t frame = alloc_frame(coro);
         if (frame == NULL_FRAME) {
@@ -360,7 +583,23 @@ void *map_vaddr_to_sos(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr
 
     invalidate_frame(pte->frame);
 
-    void *addr = frame_data(pte->frame);
+    return frame_data(pte->frame);
+}
+
+void *map_vaddr_to_sos(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, pte_t *ppte, size_t *size, coro_t coro) {
+    vaddr_t vbase = PAGE_ALIGN_4K(vaddr);
+    size_t offset = vaddr - vbase;
+    pte_t *pte = get_pte(as, vbase, true, coro);
+    if (pte == NULL) {
+        ZF_LOGE("pte is null");
+        return NULL;
+    }
+
+    /* we keep using pte across frame allocation and page in */
+    pte_hold(pte);
+    void *addr = map_pte_to_sos(cspace, as, proc, vaddr, pte, coro);
+    pte_release(pte);
+    if (addr == NULL) return NULL;
     //printf("%p\n", addr);
 
     *size = PAGE_SIZE_4K - offset;
@@ -373,51 +612,111 @@ void unmap_vaddr_from_sos(cspace_t *cspace, pte_t pte) {
     // we don't do anything
 }
 
-int copy_in(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *dest, coro_t coro) {
-    size_t rs;
-    pte_t lc;
-    void *src;
-    while (size > 0) {
-        region_t *r = get_region_with_possible_stack_extension(as, vaddr);
-        if (!r) return -1;
-        if (!(seL4_CapRights_get_capAllowRead(r->rights))) return -1;
-        src = map_vaddr_to_sos(cspace, as, proc, vaddr, &lc, &rs, coro);
-        if (src == NULL) return -1;
-        if (size < rs) rs = size;
-        if (r->memsize < rs) rs = r->memsize;
-        memcpy(dest, src, rs);
-        size -= rs;
-        dest += rs;
-        vaddr += rs;
-        unmap_vaddr_from_sos(cspace, lc);
+bool range_resident(addrspace_t *as, vaddr_t vaddr, size_t size) {
+    for (vaddr_t page = PAGE_ALIGN_4K(vaddr); page < vaddr + size; page += PAGE_SIZE_4K) {
+        pte_t *pte = get_pte(as, page, false, NULL);
+        if (pte == NULL || !pte->inuse || pte->type != IN_MEM) return false;
     }
-    return 0;
+    return true;
 }
 
-int copy_out(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *src, coro_t coro) {
+void user_cursor_init(user_cursor_t *uc, cspace_t *cspace, addrspace_t *as, process_t *proc, bool to_user) {
+    uc->cspace = cspace;
+    uc->as = as;
+    uc->proc = proc;
+    uc->to_user = to_user;
+    uc->region = NULL;
+    uc->exec = false;
+    uc->leaf = NULL;
+    uc->leaf_base = 0;
+    uc->gen = as->gen;
+}
+
+void *user_cursor_map(user_cursor_t *uc, vaddr_t vaddr, size_t size, size_t *len, pte_t *ppte, coro_t coro) {
+    if (uc->gen != uc->as->gen) {
+        uc->region = NULL;
+        uc->leaf = NULL;
+        uc->gen = uc->as->gen;
+    }
+
+    region_t *r = uc->region;
+    if (r == NULL || vaddr < r->vbase || vaddr >= VEND(r)) {
+        r = get_region_with_possible_stack_extension(uc->as, vaddr);
+        if (r == NULL) return NULL;
+        if (uc->to_user ? !seL4_CapRights_get_capAllowWrite(r->rights) :
+                          !seL4_CapRights_get_capAllowRead(r->rights)) return NULL;
+        uc->region = r;
+        uc->exec = !(r->attrs & seL4_ARM_ExecuteNever);
+    }
+
+    vaddr_t page = PAGE_ALIGN_4K(vaddr);
+    size_t offset = vaddr - page;
+    *len = MIN(size, MIN(PAGE_SIZE_4K - offset, VEND(r) - vaddr));
+
+    pte_t *pte = NULL;
+    if (uc->leaf != NULL && page - uc->leaf_base < LEAF_SPAN) {
+        pte = (pte_t *) (uc->leaf->entries + get_vaddr_level_idx(page, 0));
+    }
+
+    if (pte != NULL && pte->inuse && pte->type == IN_MEM) {
+        /* resident, no need to go through the tables again */
+        seL4_ARM_Page_Invalidate_Data(frame_page(pte->frame), offset, offset + *len);
+        *ppte = *pte;
+        return frame_data(pte->frame) + offset;
+    }
+
     size_t rs;
-    pte_t lc;
-    void *dest;
+    void *data = map_vaddr_to_sos(uc->cspace, uc->as, uc->proc, vaddr, ppte, &rs, coro);
+    if (data == NULL) return NULL;
+    /* the tables may have been extended, pick up the leaf for next time */
+    uc->leaf = get_pt_level(uc->as, page, 1, false, NULL);
+    uc->leaf_base = page & ~(LEAF_SPAN - 1);
+    return data;
+}
+
+void user_cursor_sync(user_cursor_t *uc, pte_t *pte, size_t offset, size_t len) {
+    if (!uc->to_user || len == 0) return;
+    seL4_ARM_Page sos_page = frame_page(pte->frame);
+    bool exec = uc->exec;
+    seL4_ARM_Page_Clean_Data(sos_page, offset, offset + len);
+    if (exec) seL4_ARM_Page_Unify_Instruction(sos_page, offset, offset + len);
+    /* a region went away while we were blocked, pte->cap may be stale */
+    if (pte->mapped && uc->gen == uc->as->gen) {
+        seL4_ARM_Page_Invalidate_Data(pte->cap, offset, offset + len);
+        if (exec) seL4_ARM_Page_Unify_Instruction(pte->cap, offset, offset + len);
+    }
+}
+
+static int copy_user(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *buf,
+                     bool to_user, coro_t coro) {
+    user_cursor_t uc;
+    user_cursor_init(&uc, cspace, as, proc, to_user);
     while (size > 0) {
-        region_t *r = get_region_with_possible_stack_extension(as, vaddr);
-        if (!r) return -1;
-        if (!(seL4_CapRights_get_capAllowWrite(r->rights))) return -1;
-        dest = map_vaddr_to_sos(cspace, as, proc, vaddr, &lc, &rs, coro);
-        if (dest == NULL) return -1;
-        if (size < rs) rs = size;
-        if (r->memsize < rs) rs = r->memsize;
-        memcpy(dest, src, rs);
-        size -= rs;
-        src += rs;
-        vaddr += rs;
-        flush_frame(lc.frame);
-        seL4_ARM_Page_Invalidate_Data(lc.cap, 0, PAGE_SIZE_4K);
-        seL4_ARM_Page_Unify_Instruction(lc.cap, 0, PAGE_SIZE_4K);
-        unmap_vaddr_from_sos(cspace, lc);
+        size_t len;
+        pte_t pte;
+        void *data = user_cursor_map(&uc, vaddr, size, &len, &pte, coro);
+        if (data == NULL) return -1;
+        if (to_user) {
+            memcpy(data, buf, len);
+        } else {
+            memcpy(buf, data, len);
+        }
+        user_cursor_sync(&uc, &pte, vaddr - PAGE_ALIGN_4K(vaddr), len);
+        size -= len;
+        buf += len;
+        vaddr += len;
     }
     return 0;
 }
 
+int copy_in(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *dest, coro_t coro) {
+    return copy_user(cspace, as, proc, vaddr, size, dest, false, coro);
+}
+
+int copy_out(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *src, coro_t coro) {
+    return copy_user(cspace, as, proc, vaddr, size, src, true, coro);
+}
+
 seL4_Error app_map_device(cspace_t *cspace, addrspace_t *as, vaddr_t vaddr, pte_t *pte, coro_t coro) {
     return map_frame_impl(as, cspace, pte->frame, vaddr, seL4_AllRights, seL4_ARM_Default_VMAttributes | seL4_ARM_ExecuteNever, NULL, coro);
 }
@@ -471,7 +770,8 @@ seL4_Error app_alloc_map_device(cspace_t *cspace, addrspace_t *as, vaddr_t vaddr
 
 }
 
-seL4_Error sos_clone_and_map_device_frame(addrspace_t *as, cspace_t *cspace, seL4_CPtr device_cap, seL4_Word vaddr, coro_t coro) {
+seL4_Error sos_clone_and_map_device_frame(addrspace_t *as, cspace_t *cspace, seL4_CPtr device_cap, seL4_Word vaddr,
+                                          seL4_CapRights_t rights, seL4_ARM_VMAttributes attrs, coro_t coro) {
     /* allocate a slot to duplicate the frame cap so we can map it into the application */
     seL4_CPtr frame_cptr = cspace_alloc_slot(cspace);
     if (frame_cptr == seL4_CapNull) {
@@ -488,7 +788,7 @@ seL4_Error sos_clone_and_map_device_frame(addrspace_t *as, cspace_t *cspace, seL
     }
 
     /* map frame */
-    err = map_frame_impl(as, cspace, frame_cptr, vaddr, seL4_AllRights, 0, NULL, coro);
+    err = map_frame_impl(as, cspace, frame_cptr, vaddr, rights, attrs, NULL, coro);
     if (err != 0) {
         cspace_delete(cspace, frame_cptr);
         cspace_free_slot(cspace, frame_cptr);
@@ -30,8 +30,10 @@ typedef enum {
 
 PACKED struct pde {
     seL4_Word reserved : 16;
-    frame_ref_t frame : 20;
-    seL4_Word free : 27;
+    frame_ref_t frame : 20;     /* pagefile index if paged_out */
+    seL4_Word free : 25;
+    bool paged_out : 1;         /* leaf table is in the pagefile */
+    bool paging : 1;            /* leaf table is being paged out or in */
     bool inuse : 1;
 };
 
@@ -56,16 +58,83 @@ typedef struct page_table {
 seL4_Error sos_map_frame(struct addrspace *as, cspace_t *cspace, seL4_CPtr frame_cap, seL4_Word vaddr,
                      seL4_CapRights_t rights, seL4_ARM_VMAttributes attr, pte_t *pte, coro_t coro);
 
-seL4_Error create_pt(pde_t *entry, coro_t coro);
+seL4_Error create_pt(addrspace_t *as, pde_t *entry, int level, coro_t coro);
+/*
+ * Returns the pte of vaddr. The pointer is only good until the next yield,
+ * unless the pte is held. If its leaf table is paged out, it is paged back
+ * in, or NULL is returned if coro is NULL.
+ */
 pte_t *get_pte(addrspace_t *as, vaddr_t vaddr, bool create, coro_t coro);
+/*
+ * Leaf page tables are paged out once nothing in them is resident. Hold a
+ * pte to keep its table in memory while yielding with a pointer to it.
+ */
+void pte_hold(pte_t *pte);
+void pte_release(pte_t *pte);
+/* true if the leaf table in frame is held by no one and maps nothing resident */
+bool pt_evictable(frame_ref_t frame);
+/* the leaf table in frame is about to be paged out */
+void pt_evicting(frame_ref_t frame);
 seL4_Error alloc_map_frame(addrspace_t *as, cspace_t *cspace, seL4_Word vaddr,
                     seL4_CapRights_t rights, seL4_ARM_VMAttributes attrs, pte_t *pte, coro_t coro, bool pinned);
 void unalloc_frame(addrspace_t *as, cspace_t *cspace, vaddr_t vaddr, coro_t coro);
+/*
+ * Unallocate every page in [start, end) and free the page tables that are
+ * left empty. Costs time in the number of tables actually present.
+ */
+void unalloc_range(addrspace_t *as, cspace_t *cspace, vaddr_t start, vaddr_t end, coro_t coro);
+/*
+ * Like unalloc_range, but only drops ordinary memory SOS isn't using: pinned
+ * frames (e.g. one a syscall is reading into), device and shared pages stay.
+ */
+void discard_range(addrspace_t *as, cspace_t *cspace, vaddr_t start, vaddr_t end, coro_t coro);
+/*
+ * Fault in the pages of [start, end) ahead of use. With all set every page
+ * gets mapped, otherwise only paged out ones are brought back. The range
+ * must lie in regions of as. Returns -ENOMEM if a page couldn't be mapped.
+ */
+int prefault_range(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t start, vaddr_t end, bool all, coro_t coro);
 void *map_vaddr_to_sos(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, pte_t *ppte, size_t *size, coro_t coro);
 void unmap_vaddr_from_sos(cspace_t *cspace, pte_t pte);
+/* true if every page in [vaddr, vaddr + size) is backed by a frame in memory */
+bool range_resident(addrspace_t *as, vaddr_t vaddr, size_t size);
+
+/*
+ * Cursor over user memory that SOS reads from (or writes to, if to_user).
+ * It remembers the region and leaf page table of the last page it mapped,
+ * so consecutive pages cost one PTE lookup each instead of a region list
+ * and page table walk. Both are dropped if the address space has lost a
+ * region since, as the process may unmap memory while we are blocked.
+ */
+typedef struct user_cursor {
+    cspace_t *cspace;
+    addrspace_t *as;
+    process_t *proc;
+    bool to_user;
+    region_t *region;       /* region of the last page, NULL if none yet */
+    bool exec;              /* region of the last page is executable */
+    page_table_t *leaf;     /* leaf table of the last page, NULL if none yet */
+    vaddr_t leaf_base;      /* first vaddr covered by leaf */
+    unsigned long gen;      /* as->gen when region and leaf were looked up */
+} user_cursor_t;
+
+void user_cursor_init(user_cursor_t *uc, cspace_t *cspace, addrspace_t *as, process_t *proc, bool to_user);
+/*
+ * Map the page holding vaddr into SOS, faulting it in if needed. *len is
+ * set to how much of size fits in that page and region. Returns the SOS
+ * address of vaddr, or NULL if it can't be accessed.
+ */
+void *user_cursor_map(user_cursor_t *uc, vaddr_t vaddr, size_t size, size_t *len, pte_t *pte, coro_t coro);
+/*
+ * Cache maintenance after writing len bytes at offset into the page of pte.
+ * Only uses what user_cursor_map recorded, as the region may be gone by now.
+ */
+void user_cursor_sync(user_cursor_t *uc, pte_t *pte, size_t offset, size_t len);
+
 int copy_in(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *dest, coro_t coro);
 int copy_out(cspace_t *cspace, addrspace_t *as, process_t *proc, vaddr_t vaddr, size_t size, void *src, coro_t coro);
 void pagetable_destroy(addrspace_t *as, cspace_t *cspace, coro_t coro);
 seL4_Error app_map_device(cspace_t *cspace, addrspace_t *as, vaddr_t vaddr, pte_t *pte, coro_t coro);
 seL4_Error app_alloc_map_device(cspace_t *cspace, addrspace_t *as, vaddr_t vaddr, uintptr_t addr, coro_t coro);
-seL4_Error sos_clone_and_map_device_frame(addrspace_t *as, cspace_t *cspace, seL4_CPtr device_cap, seL4_Word vaddr, coro_t coro);
+seL4_Error sos_clone_and_map_device_frame(addrspace_t *as, cspace_t *cspace, seL4_CPtr device_cap, seL4_Word vaddr,
+                                          seL4_CapRights_t rights, seL4_ARM_VMAttributes attrs, coro_t coro);
@@ -20,14 +20,22 @@
 #define SOS_SCRATCH          (0xA0000000)
 #define SOS_DEVICE_START     (0xB0000000)
 #define SOS_STACK            (0xC0000000)
-#define SOS_STACK_PAGES      100
+#define SOS_STACK_PAGES      32
 #define SOS_UT_TABLE         (0x8000000000)
 #define SOS_FRAME_TABLE      (0x8100000000)
 #define SOS_FRAME_DATA       (0x8200000000)
 #define SOS_PROC_VADDR_MAP   (0x9000000000)
+/* Coroutine stacks, one fixed-size slot each with a guard page at the bottom */
+#define SOS_CORO_STACKS      (0xD000000000)
 
 /* Constants for how SOS will layout the address space of any processes it loads up */
 #define PROCESS_STACK_BOTTOM (0x9000000000)
 #define PROCESS_IPC_BUFFER   (0x9000000000)
+/* mmap(NULL) places regions in the first hole in this range */
+#define PROCESS_MMAP_BASE    (PROCESS_IPC_BUFFER + PAGE_SIZE_4K)
+#define PROCESS_MMAP_TOP     (0x800000000000)
+
+/* read-only timer page, SOS_TIMER_PAGE_VADDR in sos.h */
+#define PROCESS_TIMER_PAGE   (0xA000000000)
 
 #define CLOCK_DRIVER_ADDR    (0xC000000000)
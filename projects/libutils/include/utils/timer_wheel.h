@@ -0,0 +1,67 @@
+/* Hierarchical timing wheel with O(1) insert and cancel. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * TW_LEVELS wheels of TW_LEVEL_SIZE slots each. A slot of level L spans
+ * TW_LEVEL_SIZE^L ticks, so the whole wheel covers TW_LEVEL_SIZE^TW_LEVELS
+ * ticks ahead. Timers further out than that park in the last slot they can
+ * reach and are re-filed when it comes round.
+ */
+#define TW_LEVEL_BITS 6
+#define TW_LEVEL_SIZE (1 << TW_LEVEL_BITS)
+#define TW_LEVELS     4
+
+/* Embed this in your own timer struct. Only touched by the tw_* functions. */
+typedef struct tw_timer {
+    struct tw_timer *prev;
+    struct tw_timer *next;
+    uint64_t expires;       /* tick the timer is due at */
+    int8_t level;           /* -1 if not pending */
+    uint8_t slot;
+} tw_timer_t;
+
+typedef struct {
+    uint64_t tick_us;       /* resolution of the wheel */
+    uint64_t slack;         /* deadlines are rounded up to a multiple of this many ticks */
+    uint64_t now;           /* next tick to be processed */
+    size_t count;           /* pending timers */
+    uint64_t occupied[TW_LEVELS];
+    tw_timer_t *slots[TW_LEVELS][TW_LEVEL_SIZE];
+} tw_t;
+
+/*
+ * Create an empty wheel. Deadlines closer together than slack_us may be
+ * coalesced, i.e. a timer fires up to slack_us + tick_us after its deadline,
+ * never before it. Returns 0 on success.
+ */
+int tw_init(tw_t *tw, uint64_t tick_us, uint64_t slack_us, uint64_t now_us);
+
+/* Arm t to fire at deadline_us. t must not be pending. */
+void tw_add(tw_t *tw, tw_timer_t *t, uint64_t deadline_us);
+
+/* Disarm t. Does nothing if t is not pending. */
+void tw_cancel(tw_t *tw, tw_timer_t *t);
+
+/* Returns true if t is armed and has not fired yet. */
+bool tw_pending(tw_timer_t *t);
+
+/*
+ * Advance the wheel to now_us and return every timer that is due, chained
+ * through their next pointers. The returned timers are no longer pending,
+ * so they may be re-armed straight away.
+ */
+tw_timer_t *tw_expire(tw_t *tw, uint64_t now_us);
+
+/*
+ * Time at which tw_expire next has work to do, either firing timers or
+ * moving them down a level. Returns false if the wheel is empty.
+ */
+bool tw_next(tw_t *tw, uint64_t *deadline_us);
+
+/* Returns the number of pending timers. */
+size_t tw_length(tw_t *tw);
@@ -0,0 +1,164 @@
+/* Hierarchical timing wheel with O(1) insert and cancel. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "utils/timer_wheel.h"
+
+/* NOTE: NOT THREAD SAFE */
+
+#define TW_MASK (TW_LEVEL_SIZE - 1)
+#define TW_RANGE (1ull << (TW_LEVELS * TW_LEVEL_BITS))
+
+static inline uint64_t level_span(int level) {
+    return 1ull << (level * TW_LEVEL_BITS);
+}
+
+/* Rotate an occupancy mask so that bit 0 is slot "from" */
+static inline uint64_t rotate(uint64_t mask, int from) {
+    return (mask >> from) | (mask << ((TW_LEVEL_SIZE - from) & TW_MASK));
+}
+
+/*
+ * A timer in slot s of level L is looked at on the first tick, from now on,
+ * that is a multiple of level_span(L) and whose level L index is s. Pick the
+ * lowest level where that tick is the start of the span holding the expiry,
+ * so the timer either fires there or drops to a lower level in time.
+ */
+static void tw_place(tw_t *tw, tw_timer_t *t) {
+    uint64_t expires = t->expires;
+    if (expires < tw->now) expires = tw->now;
+    if (expires - tw->now >= TW_RANGE) expires = tw->now + TW_RANGE - 1;
+
+    int level;
+    for (level = 0; level < TW_LEVELS - 1; level++) {
+        uint64_t span = level_span(level);
+        uint64_t start = expires & ~(span - 1);
+        uint64_t base = (tw->now + span - 1) & ~(span - 1);
+        if (start >= tw->now && start - base < span * TW_LEVEL_SIZE) break;
+    }
+
+    int slot = (expires >> (level * TW_LEVEL_BITS)) & TW_MASK;
+    t->level = level;
+    t->slot = slot;
+    t->prev = NULL;
+    t->next = tw->slots[level][slot];
+    if (t->next) t->next->prev = t;
+    tw->slots[level][slot] = t;
+    tw->occupied[level] |= 1ull << slot;
+}
+
+static void tw_unlink(tw_t *tw, tw_timer_t *t) {
+    if (t->prev) t->prev->next = t->next;
+    else tw->slots[t->level][t->slot] = t->next;
+    if (t->next) t->next->prev = t->prev;
+    if (tw->slots[t->level][t->slot] == NULL) tw->occupied[t->level] &= ~(1ull << t->slot);
+    t->level = -1;
+}
+
+/* First tick from now on at which tw_expire has something to do */
+static uint64_t tw_next_tick(tw_t *tw) {
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < TW_LEVELS; level++) {
+        if (tw->occupied[level] == 0) continue;
+        uint64_t span = level_span(level);
+        uint64_t base = (tw->now + span - 1) & ~(span - 1);
+        int from = (base >> (level * TW_LEVEL_BITS)) & TW_MASK;
+        uint64_t tick = base + __builtin_ctzll(rotate(tw->occupied[level], from)) * span;
+        if (tick < best) best = tick;
+    }
+    return best;
+}
+
+int tw_init(tw_t *tw, uint64_t tick_us, uint64_t slack_us, uint64_t now_us) {
+    if (tw == NULL || tick_us == 0) {
+        return -EINVAL;
+    }
+    memset(tw, 0, sizeof(*tw));
+    tw->tick_us = tick_us;
+    tw->slack = slack_us / tick_us;
+    if (tw->slack == 0) tw->slack = 1;
+    tw->now = now_us / tick_us;
+    return 0;
+}
+
+void tw_add(tw_t *tw, tw_timer_t *t, uint64_t deadline_us) {
+    /* round up, firing late is fine but early is not */
+    uint64_t expires = (deadline_us + tw->tick_us - 1) / tw->tick_us;
+    /* nearby deadlines share a tick, so they fire from one interrupt */
+    expires = (expires + tw->slack - 1) / tw->slack * tw->slack;
+    t->expires = expires;
+    tw_place(tw, t);
+    tw->count++;
+}
+
+void tw_cancel(tw_t *tw, tw_timer_t *t) {
+    if (!tw_pending(t)) return;
+    tw_unlink(tw, t);
+    tw->count--;
+}
+
+bool tw_pending(tw_timer_t *t) {
+    return t->level >= 0;
+}
+
+/* Re-file everything in slot "slot" of "level" relative to the current tick */
+static void tw_cascade(tw_t *tw, int level, int slot) {
+    tw_timer_t *t = tw->slots[level][slot];
+    tw->slots[level][slot] = NULL;
+    tw->occupied[level] &= ~(1ull << slot);
+    while (t != NULL) {
+        tw_timer_t *next = t->next;
+        tw_place(tw, t);
+        t = next;
+    }
+}
+
+tw_timer_t *tw_expire(tw_t *tw, uint64_t now_us) {
+    uint64_t target = now_us / tw->tick_us;
+    tw_timer_t *expired = NULL;
+
+    while (tw->now <= target) {
+        /* skip over ticks where nothing happens */
+        uint64_t tick = tw_next_tick(tw);
+        if (tick > target) {
+            tw->now = target + 1;
+            break;
+        }
+        tw->now = tick;
+
+        /* higher levels whose slot starts at this tick drop their timers down */
+        for (int level = TW_LEVELS - 1; level > 0; level--) {
+            if (tick & (level_span(level) - 1)) continue;
+            tw_cascade(tw, level, (tick >> (level * TW_LEVEL_BITS)) & TW_MASK);
+        }
+
+        int slot = tick & TW_MASK;
+        tw_timer_t *t = tw->slots[0][slot];
+        tw->slots[0][slot] = NULL;
+        tw->occupied[0] &= ~(1ull << slot);
+        while (t != NULL) {
+            tw_timer_t *next = t->next;
+            t->level = -1;
+            t->prev = NULL;
+            t->next = expired;
+            expired = t;
+            tw->count--;
+            t = next;
+        }
+        tw->now = tick + 1;
+    }
+    return expired;
+}
+
+bool tw_next(tw_t *tw, uint64_t *deadline_us) {
+    if (tw->count == 0) return false;
+    *deadline_us = tw_next_tick(tw) * tw->tick_us;
+    return true;
+}
+
+size_t tw_length(tw_t *tw) {
+    return tw == NULL ? 0 : tw->count;
+}
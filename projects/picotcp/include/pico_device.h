@@ -29,6 +29,9 @@ struct pico_device {
     struct pico_queue *q_out;
     int (*link_state)(struct pico_device *self);
     int (*send)(struct pico_device *self, void *buf, int len); /* Send function. Return 0 if busy */
+    /* Optional zero-copy send. The driver may hold on to the buffer by taking a
+     * reference with pico_frame_copy(). Return 0 if busy */
+    int (*send_frame)(struct pico_device *self, struct pico_frame *f);
     int (*poll)(struct pico_device *self, int loop_score);
     void (*destroy)(struct pico_device *self);
     int (*dsr)(struct pico_device *self, int loop_score);
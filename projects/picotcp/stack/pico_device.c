@@ -336,6 +336,9 @@ static int devloop_sendto_dev(struct pico_device *dev, struct pico_frame *f)
         return (pico_6lowpan_ll_sendto_dev(dev, f) <= 0);
     }
 #endif
+    if (dev->send_frame)
+        return (dev->send_frame(dev, f) <= 0);
+
     return (dev->send(dev, f->start, (int)f->len) <= 0);
 }
 
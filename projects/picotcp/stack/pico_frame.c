@@ -17,6 +17,18 @@
 static int n_frames_allocated;
 #endif
 
+/* Memory for frames, their buffers and usage counters. The platform may
+ * override these to keep packets out of the general heap. */
+void * WEAK pico_frame_mem_zalloc(size_t size)
+{
+    return PICO_ZALLOC(size);
+}
+
+void WEAK pico_frame_mem_free(void *ptr)
+{
+    PICO_FREE(ptr);
+}
+
 /** frame alloc/dealloc/copy **/
 void pico_frame_discard(struct pico_frame *f)
 {
@@ -26,14 +38,14 @@ void pico_frame_discard(struct pico_frame *f)
     (*f->usage_count)--;
     if (*f->usage_count == 0) {
         if (f->flags & PICO_FRAME_FLAG_EXT_USAGE_COUNTER)
-            PICO_FREE(f->usage_count);
+            pico_frame_mem_free(f->usage_count);
 
 #ifdef PICO_SUPPORT_DEBUG_MEMORY
         dbg("Discarded buffer @%p, caller: %p\n", f->buffer, __builtin_return_address(3));
         dbg("DEBUG MEMORY: %d frames in use.\n", --n_frames_allocated);
 #endif
         if (!(f->flags & PICO_FRAME_FLAG_EXT_BUFFER))
-            PICO_FREE(f->buffer);
+            pico_frame_mem_free(f->buffer);
         else if (f->notify_free)
             f->notify_free(f->buffer);
 
@@ -46,12 +58,12 @@ void pico_frame_discard(struct pico_frame *f)
         dbg("Removed frame @%p(copy), usage count now: %d\n", f, *f->usage_count);
     }
 #endif
-    PICO_FREE(f);
+    pico_frame_mem_free(f);
 }
 
 struct pico_frame *pico_frame_copy(struct pico_frame *f)
 {
-    struct pico_frame *new = PICO_ZALLOC(sizeof(struct pico_frame));
+    struct pico_frame *new = pico_frame_mem_zalloc(sizeof(struct pico_frame));
     if (!new)
         return NULL;
 
@@ -66,14 +78,14 @@ struct pico_frame *pico_frame_copy(struct pico_frame *f)
 
 static struct pico_frame *pico_frame_do_alloc(uint32_t size, int zerocopy, int ext_buffer)
 {
-    struct pico_frame *p = PICO_ZALLOC(sizeof(struct pico_frame));
+    struct pico_frame *p = pico_frame_mem_zalloc(sizeof(struct pico_frame));
     uint32_t frame_buffer_size = size;
     if (!p)
         return NULL;
 
     if (ext_buffer && !zerocopy) {
         /* external buffer implies zerocopy flag! */
-        PICO_FREE(p);
+        pico_frame_mem_free(p);
         return NULL;
     }
 
@@ -84,9 +96,9 @@ static struct pico_frame *pico_frame_do_alloc(uint32_t size, int zerocopy, int e
             frame_buffer_size += (uint32_t)sizeof(uint32_t) - align;
         }
 
-        p->buffer = PICO_ZALLOC((size_t)frame_buffer_size + sizeof(uint32_t));
+        p->buffer = pico_frame_mem_zalloc((size_t)frame_buffer_size + sizeof(uint32_t));
         if (!p->buffer) {
-            PICO_FREE(p);
+            pico_frame_mem_free(p);
             return NULL;
         }
 
@@ -94,9 +106,9 @@ static struct pico_frame *pico_frame_do_alloc(uint32_t size, int zerocopy, int e
     } else {
         p->buffer = NULL;
         p->flags |= PICO_FRAME_FLAG_EXT_USAGE_COUNTER;
-        p->usage_count = PICO_ZALLOC(sizeof(uint32_t));
+        p->usage_count = pico_frame_mem_zalloc(sizeof(uint32_t));
         if (!p->usage_count) {
-            PICO_FREE(p);
+            pico_frame_mem_free(p);
             return NULL;
         }
     }
@@ -150,7 +162,7 @@ pico_frame_new_buffer(struct pico_frame *f, uint32_t size, uint32_t *oldsize)
     *oldsize = f->buffer_len;
     usage_count = *(f->usage_count);
     p_old_usage = f->usage_count;
-    f->buffer = PICO_ZALLOC((size_t)frame_buffer_size + sizeof(uint32_t));
+    f->buffer = pico_frame_mem_zalloc((size_t)frame_buffer_size + sizeof(uint32_t));
     if (!f->buffer) {
         f->buffer = oldbuf;
         return NULL;
@@ -161,7 +173,7 @@ pico_frame_new_buffer(struct pico_frame *f, uint32_t size, uint32_t *oldsize)
     f->buffer_len = size;
 
     if (f->flags & PICO_FRAME_FLAG_EXT_USAGE_COUNTER)
-        PICO_FREE(p_old_usage);
+        pico_frame_mem_free(p_old_usage);
     /* Now, the frame is not zerocopy anymore, and the usage counter has been moved within it */
     return oldbuf;
 }
@@ -177,7 +189,7 @@ pico_frame_update_pointers(struct pico_frame *f, ptrdiff_t addr_diff, uint8_t *o
     f->payload += addr_diff;
 
     if (!(f->flags & PICO_FRAME_FLAG_EXT_BUFFER))
-        PICO_FREE(oldbuf);
+        pico_frame_mem_free(oldbuf);
     else if (f->notify_free)
         f->notify_free(oldbuf);
 
@@ -276,7 +288,7 @@ struct pico_frame *pico_frame_deepcopy(struct pico_frame *f)
 }
 
 
-static inline uint32_t pico_checksum_adder(uint32_t sum, void *data, uint32_t len)
+static inline uint32_t pico_checksum_adder_scalar(uint32_t sum, void *data, uint32_t len)
 {
     uint16_t *buf = (uint16_t *)data;
     uint16_t *stop;
@@ -298,6 +310,77 @@ static inline uint32_t pico_checksum_adder(uint32_t sum, void *data, uint32_t le
     return sum;
 }
 
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(PICO_BIGENDIAN)
+#include <arm_neon.h>
+#define PICO_CHECKSUM_NEON
+
+/* Shorter buffers are not worth setting up the vector loop for */
+#define PICO_CHECKSUM_NEON_MIN   64
+/* 64 byte blocks summed before the 32 bit lanes are widened; each block
+ * adds at most 2 * 0xFFFF to a lane, so this is far from overflowing */
+#define PICO_CHECKSUM_NEON_ROUND 4096
+
+/*
+ * Same sum as pico_checksum_adder_scalar, modulo 0xFFFF, which is all the
+ * one's complement checksum cares about. 16 bit words are added pairwise
+ * into four independent 32 bit accumulators, widened to 64 bits once per
+ * round, and the tail is left to the scalar loop. The result is folded to
+ * 16 bits, so it never overflows when fed back in as sum.
+ */
+static uint32_t pico_checksum_adder_neon(uint32_t sum, void *data, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)data;
+    uint64x2_t acc = vdupq_n_u64(0);
+    uint64_t total;
+
+    while (len >= 64) {
+        uint32x4_t s0 = vdupq_n_u32(0), s1 = s0, s2 = s0, s3 = s0;
+        uint32_t blocks = len >> 6;
+        if (blocks > PICO_CHECKSUM_NEON_ROUND)
+            blocks = PICO_CHECKSUM_NEON_ROUND;
+
+        len -= blocks << 6;
+        while (blocks--) {
+            s0 = vpadalq_u16(s0, vreinterpretq_u16_u8(vld1q_u8(p)));
+            s1 = vpadalq_u16(s1, vreinterpretq_u16_u8(vld1q_u8(p + 16)));
+            s2 = vpadalq_u16(s2, vreinterpretq_u16_u8(vld1q_u8(p + 32)));
+            s3 = vpadalq_u16(s3, vreinterpretq_u16_u8(vld1q_u8(p + 48)));
+            p += 64;
+        }
+        acc = vpadalq_u32(acc, s0);
+        acc = vpadalq_u32(acc, s1);
+        acc = vpadalq_u32(acc, s2);
+        acc = vpadalq_u32(acc, s3);
+    }
+
+    if (len >= 16) {
+        uint32x4_t s = vdupq_n_u32(0);
+        while (len >= 16) {
+            s = vpadalq_u16(s, vreinterpretq_u16_u8(vld1q_u8(p)));
+            p += 16;
+            len -= 16;
+        }
+        acc = vpadalq_u32(acc, s);
+    }
+
+    total = (uint64_t)sum + vaddvq_u64(acc);
+    total += pico_checksum_adder_scalar(0, p, len);
+    while (total >> 16) {
+        total = (total & 0xFFFF) + (total >> 16);
+    }
+    return (uint32_t)total;
+}
+#endif
+
+static inline uint32_t pico_checksum_adder(uint32_t sum, void *data, uint32_t len)
+{
+#ifdef PICO_CHECKSUM_NEON
+    if (len >= PICO_CHECKSUM_NEON_MIN)
+        return pico_checksum_adder_neon(sum, data, len);
+#endif
+    return pico_checksum_adder_scalar(sum, data, len);
+}
+
 static inline uint16_t pico_checksum_finalize(uint32_t sum)
 {
     while (sum >> 16) { /* a second carry is possible! */
@@ -481,21 +481,21 @@ static int32_t _pico_stack_recv_zerocopy(struct pico_device *dev, uint8_t *buffe
     struct pico_frame *f;
     int ret;
     if (len == 0)
-        return -1;
+        goto fail;
 
     f = pico_frame_alloc_skeleton(len, ext_buffer);
     if (!f)
     {
         dbg("Cannot alloc incoming frame!\n");
-        return -1;
+        goto fail;
     }
 
     if (pico_frame_skeleton_set_buffer(f, buffer) < 0)
     {
         dbg("Invalid zero-copy buffer!\n");
-        PICO_FREE(f->usage_count);
-        PICO_FREE(f);
-        return -1;
+        pico_frame_mem_free(f->usage_count);
+        pico_frame_mem_free(f);
+        goto fail;
     }
 
     if (notify_free) {
@@ -509,6 +509,13 @@ static int32_t _pico_stack_recv_zerocopy(struct pico_device *dev, uint8_t *buffe
     }
 
     return ret;
+
+fail:
+    /* a buffer handed over with notify_free always comes back through it */
+    if (ext_buffer && notify_free)
+        notify_free(buffer);
+
+    return -1;
 }
 
 int32_t pico_stack_recv_zerocopy(struct pico_device *dev, uint8_t *buffer, uint32_t len)
@@ -651,6 +658,22 @@ void pico_timer_cancel_hashed(uint32_t hash)
     }
 }
 
+/* Stores the expiry of the earliest timer in *expire, returns -1 if there are no timers.
+ * The timer fires on the first pico_stack_tick() after that millisecond. */
+int pico_timer_next(pico_time *expire)
+{
+    struct pico_timer_ref *tref;
+    if (!Timers)
+        return -1;
+
+    tref = heap_first(Timers);
+    if (!tref)
+        return -1;
+
+    *expire = tref->expire;
+    return 0;
+}
+
 #define PROTO_DEF_NR      11
 #define PROTO_DEF_AVG_NR  4
 #define PROTO_DEF_SCORE   32
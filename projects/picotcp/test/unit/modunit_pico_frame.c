@@ -237,6 +237,59 @@ START_TEST(tc_pico_is_hex)
 }
 END_TEST
 
+/* RFC 1071, a byte at a time in network order */
+static uint16_t checksum_reference(uint8_t *buf, uint32_t len)
+{
+    uint32_t sum = 0;
+    uint32_t i;
+    for (i = 0; i + 1 < len; i += 2)
+        sum += (uint32_t)((buf[i] << 8) | buf[i + 1]);
+    if (len & 1)
+        sum += (uint32_t)(buf[len - 1] << 8);
+
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+#define CHECKSUM_BUF 65536
+
+START_TEST(tc_pico_checksum)
+{
+    uint8_t *buf = PICO_ZALLOC(CHECKSUM_BUF + 16);
+    uint32_t round, len, off, len1, i;
+    uint16_t scalar;
+
+    fail_if(!buf);
+    srand(0x1071);
+    for (round = 0; round < 5000; round++) {
+        /* mostly packet sized, some up to a full IP datagram */
+        len = (uint32_t)rand() % ((round % 16) ? 2048 : CHECKSUM_BUF);
+        off = (uint32_t)rand() % 16;
+        for (i = 0; i < len; i++) {
+            switch (round % 4) {
+            case 0: buf[off + i] = 0xFF; break; /* worst case for carries */
+            case 1: buf[off + i] = 0; break;
+            default: buf[off + i] = (uint8_t)rand();
+            }
+        }
+
+        scalar = pico_checksum_finalize(pico_checksum_adder_scalar(0, buf + off, len));
+        fail_if(pico_checksum(buf + off, len) != scalar, "len %u off %u", len, off);
+        fail_if(scalar != checksum_reference(buf + off, len), "len %u off %u", len, off);
+
+        /* split as for a pseudo header, len1 must be even */
+        len1 = ((uint32_t)rand() % 41) & ~1u;
+        if (len1 > len)
+            len1 = len & ~1u;
+
+        fail_if(pico_dualbuffer_checksum(buf + off, len1, buf + off + len1, len - len1) != scalar,
+                "len %u off %u len1 %u", len, off, len1);
+    }
+    PICO_FREE(buf);
+}
+END_TEST
+
 Suite *pico_suite(void)
 {
     Suite *s = suite_create("pico_frame.c");
@@ -247,6 +300,7 @@ Suite *pico_suite(void)
     TCase *TCase_pico_frame_deepcopy = tcase_create("Unit test for pico_frame_deepcopy");
     TCase *TCase_pico_is_digit = tcase_create("Unit test for pico_is_digit");
     TCase *TCase_pico_is_hex = tcase_create("Unit test for pico_is_hex");
+    TCase *TCase_pico_checksum = tcase_create("Unit test for pico_checksum");
     tcase_add_test(TCase_pico_frame_alloc_discard, tc_pico_frame_alloc_discard);
     tcase_add_test(TCase_pico_frame_copy, tc_pico_frame_copy);
     tcase_add_test(TCase_pico_frame_grow, tc_pico_frame_grow);
@@ -254,11 +308,13 @@ Suite *pico_suite(void)
     tcase_add_test(TCase_pico_frame_deepcopy, tc_pico_frame_deepcopy);
     tcase_add_test(TCase_pico_is_digit, tc_pico_is_digit);
     tcase_add_test(TCase_pico_is_hex, tc_pico_is_hex);
+    tcase_add_test(TCase_pico_checksum, tc_pico_checksum);
     suite_add_tcase(s, TCase_pico_frame_alloc_discard);
     suite_add_tcase(s, TCase_pico_frame_copy);
     suite_add_tcase(s, TCase_pico_frame_grow);
     suite_add_tcase(s, TCase_pico_frame_grow_head);
     suite_add_tcase(s, TCase_pico_frame_deepcopy);
+    suite_add_tcase(s, TCase_pico_checksum);
     return s;
 }
 